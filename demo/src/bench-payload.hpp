@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Payload and timing helpers for the evo-bench-* apps
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+
+#define BENCH_RUNS 5
+
+
+/*
+ * Build a location status response in the format returned by the UK/EMEA portal
+ *
+ * Used when no recorded payload is given. Values vary per zone so that the
+ * parser cannot take shortcuts on repeated content.
+ */
+static std::string make_status_payload(const int numZones)
+{
+	static const char *szModes[3] = {"FollowSchedule", "TemporaryOverride", "PermanentOverride"};
+	char cBuffer[512];
+	std::string szPayload = "{\"locationId\":\"1234567\",\"gateways\":[{\"gatewayId\":\"2345678\",\"temperatureControlSystems\":[{\"systemId\":\"3456789\",\"zones\":[";
+	for (int i = 0; i < numZones; i++)
+	{
+		if (i > 0)
+			szPayload.append(",");
+		snprintf(cBuffer, sizeof(cBuffer), "{\"zoneId\":\"%d\",\"temperatureStatus\":{\"temperature\":%.2f,\"isAvailable\":true},"
+			"\"activeFaults\":[],\"setpointStatus\":{\"targetHeatTemperature\":%.1f,\"setpointMode\":\"%s\"%s},\"name\":\"Zone \\\"%d\\\" \\u00e9tage\"}",
+			4000000 + i, 18.0 + (i % 50) / 10.0, 15.0 + (i % 12) / 2.0, szModes[i % 3],
+			((i % 3) == 1) ? ",\"until\":\"2020-01-01T18:30:00Z\"" : "", i);
+		szPayload.append(cBuffer);
+	}
+	szPayload.append("],\"dhw\":{\"dhwId\":\"5000000\",\"temperatureStatus\":{\"temperature\":48.0,\"isAvailable\":true},"
+		"\"stateStatus\":{\"state\":\"On\",\"mode\":\"FollowSchedule\"},\"activeFaults\":[]},"
+		"\"activeFaults\":[],\"systemModeStatus\":{\"mode\":\"Auto\",\"isPermanent\":true}}],\"activeFaults\":[]}]}");
+	return szPayload;
+}
+
+
+static bool read_payload(const std::string &szFilename, std::string &szPayload)
+{
+	std::ifstream myfile(szFilename.c_str(), std::ios::in | std::ios::binary);
+	if (!myfile.is_open())
+		return false;
+	std::stringstream ss;
+	ss << myfile.rdbuf();
+	szPayload = ss.str();
+	return !szPayload.empty();
+}
+
+
+class BenchTimer
+{
+public:
+	BenchTimer() : m_tStart(std::chrono::steady_clock::now()) {}
+	double seconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tStart).count();
+	}
+private:
+	std::chrono::steady_clock::time_point m_tStart;
+};
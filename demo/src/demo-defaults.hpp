@@ -20,6 +20,10 @@
 #define SCHEDULE_CACHE "schedules.json"
 #endif
 
+#ifndef SCHEDULE_BINARY_CACHE
+#define SCHEDULE_BINARY_CACHE "schedules.bin"
+#endif
+
 #ifndef AUTH_FILE_V1
 #define AUTH_FILE_V1 "/tmp/evo1auth.json"
 #endif
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Benchmark for parsing status responses with and without a Json::Arena
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include "jsoncpp/json.h"
+#include "bench-payload.hpp"
+
+
+using namespace std;
+
+
+std::string payloadfile;
+int numZones = 12;
+int numIterations = 2000;
+
+std::string szERROR = "ERROR: ";
+
+
+
+
+void exit_error(std::string message)
+{
+	cerr << message << endl;
+	exit(1);
+}
+
+
+void usage(std::string mode)
+{
+	if (mode == "badparm")
+	{
+		cout << "Bad parameter" << endl;
+		exit(1);
+	}
+	if (mode == "short")
+	{
+		cout << "Usage: evo-bench-arena [-h] [-f file] [-z zones] [-n count]" << endl;
+		cout << "Type \"evo-bench-arena --help\" for more help" << endl;
+		exit(0);
+	}
+	cout << "Usage: evo-bench-arena [OPTIONS]" << endl;
+	cout << endl;
+	cout << "  -f, --file=FILE         parse recorded response FILE instead of a generated status" << endl;
+	cout << "  -z, --zones=NUM         number of zones in the generated status (default 12)" << endl;
+	cout << "  -n, --count=NUM         number of parses per run (default 2000)" << endl;
+	cout << "  -h, --help              display this help and exit" << endl;
+	exit(0);
+}
+
+
+void parse_args(int argc, char** argv) {
+	int i=1;
+	std::string word;
+	while (i < argc) {
+		word = argv[i];
+		if (word.length() > 1 && word[0] == '-' && word[1] != '-') {
+			for (size_t j=1;j<word.length();j++) {
+				if (word[j] == 'h') {
+					usage("short");
+				} else if ((word[j] == 'f') || (word[j] == 'z') || (word[j] == 'n')) {
+					if ((j+1 < word.length()) || (i+1 >= argc))
+						usage("badparm");
+					i++;
+					if (word[j] == 'f')
+						payloadfile = argv[i];
+					else if (word[j] == 'z')
+						numZones = atoi(argv[i]);
+					else
+						numIterations = atoi(argv[i]);
+				} else {
+					usage("badparm");
+				}
+			}
+		} else if (word == "--help") {
+			usage("long");
+		} else if (word.substr(0,7) == "--file=") {
+			payloadfile = word.substr(7);
+		} else if (word.substr(0,8) == "--zones=") {
+			numZones = atoi(word.substr(8).c_str());
+		} else if (word.substr(0,8) == "--count=") {
+			numIterations = atoi(word.substr(8).c_str());
+		} else {
+			usage("badparm");
+		}
+		i++;
+	}
+	if ((numZones < 1) || (numIterations < 1))
+		usage("badparm");
+}
+
+
+int main(int argc, char** argv)
+{
+	parse_args(argc, argv);
+
+	std::string szPayload;
+	if (payloadfile.empty())
+		szPayload = make_status_payload(numZones);
+	else if (!read_payload(payloadfile, szPayload))
+		exit_error(szERROR+"failed to read payload file '"+payloadfile+"'");
+
+	Json::CharReaderBuilder jBuilder;
+	std::unique_ptr<Json::CharReader> jReader(jBuilder.newCharReader());
+	const char *begin = szPayload.c_str();
+	const char *end = begin + szPayload.size();
+	std::string szErrors;
+
+	cout << "payload: " << szPayload.size() << " bytes, " << numIterations << " parses per run" << endl;
+
+	// best of several runs to reduce the influence of other load
+	double dHeap = 0;
+	double dArena = 0;
+	size_t numAllocations = 0;
+	size_t numBytes = 0;
+	Json::Arena arena;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		// heap: every string and container is a separate allocation and release
+		BenchTimer heapTimer;
+		for (int i = 0; i < numIterations; i++)
+		{
+			Json::Value jRoot;
+			if (!jReader->parse(begin, end, &jRoot, &szErrors))
+				exit_error(szERROR+"payload is not valid json: "+szErrors);
+		}
+		double dSeconds = heapTimer.seconds();
+		if ((run == 0) || (dSeconds < dHeap))
+			dHeap = dSeconds;
+
+		// arena: the tree is released in one step by resetting the arena
+		BenchTimer arenaTimer;
+		for (int i = 0; i < numIterations; i++)
+		{
+			{
+				Json::Value jRoot;
+				{
+					Json::Arena::Scope scope(arena);
+					jReader->parse(begin, end, &jRoot, &szErrors);
+				}
+				numAllocations = arena.allocationCount();
+				numBytes = arena.bytesUsed();
+			}
+			arena.reset();
+		}
+		dSeconds = arenaTimer.seconds();
+		if ((run == 0) || (dSeconds < dArena))
+			dArena = dSeconds;
+	}
+
+	double dMB = static_cast<double>(szPayload.size()) * numIterations / 1e6;
+	printf("heap:  %8.2f us/parse  %7.1f MB/s\n", dHeap * 1e6 / numIterations, dMB / dHeap);
+	printf("arena: %8.2f us/parse  %7.1f MB/s  (%zu allocations, %zu bytes per tree)\n", dArena * 1e6 / numIterations, dMB / dArena, numAllocations, numBytes);
+	printf("speedup: %.2fx\n", dHeap / dArena);
+	return 0;
+}
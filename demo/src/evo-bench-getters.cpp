@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Benchmark for the status getters with and without the per-device field cache
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include "evohomeclient2/evohomeclient2.hpp"
+#include "bench-payload.hpp"
+
+
+using namespace std;
+
+
+std::string payloadfile;
+int numZones = 12;
+int numIterations = 20000;
+
+std::string szERROR = "ERROR: ";
+
+
+
+
+void exit_error(std::string message)
+{
+	cerr << message << endl;
+	exit(1);
+}
+
+
+void usage(std::string mode)
+{
+	if (mode == "badparm")
+	{
+		cout << "Bad parameter" << endl;
+		exit(1);
+	}
+	if (mode == "short")
+	{
+		cout << "Usage: evo-bench-getters [-h] [-f file] [-z zones] [-n count]" << endl;
+		cout << "Type \"evo-bench-getters --help\" for more help" << endl;
+		exit(0);
+	}
+	cout << "Usage: evo-bench-getters [OPTIONS]" << endl;
+	cout << endl;
+	cout << "  -f, --file=FILE         use recorded status response FILE instead of a generated status" << endl;
+	cout << "  -z, --zones=NUM         number of zones in the generated status (default 12)" << endl;
+	cout << "  -n, --count=NUM         number of passes over all zones per run (default 20000)" << endl;
+	cout << "  -h, --help              display this help and exit" << endl;
+	exit(0);
+}
+
+
+void parse_args(int argc, char** argv) {
+	int i=1;
+	std::string word;
+	while (i < argc) {
+		word = argv[i];
+		if (word.length() > 1 && word[0] == '-' && word[1] != '-') {
+			for (size_t j=1;j<word.length();j++) {
+				if (word[j] == 'h') {
+					usage("short");
+				} else if ((word[j] == 'f') || (word[j] == 'z') || (word[j] == 'n')) {
+					if ((j+1 < word.length()) || (i+1 >= argc))
+						usage("badparm");
+					i++;
+					if (word[j] == 'f')
+						payloadfile = argv[i];
+					else if (word[j] == 'z')
+						numZones = atoi(argv[i]);
+					else
+						numIterations = atoi(argv[i]);
+				} else {
+					usage("badparm");
+				}
+			}
+		} else if (word == "--help") {
+			usage("long");
+		} else if (word.substr(0,7) == "--file=") {
+			payloadfile = word.substr(7);
+		} else if (word.substr(0,8) == "--zones=") {
+			numZones = atoi(word.substr(8).c_str());
+		} else if (word.substr(0,8) == "--count=") {
+			numIterations = atoi(word.substr(8).c_str());
+		} else {
+			usage("badparm");
+		}
+		i++;
+	}
+	if ((numZones < 1) || (numIterations < 1))
+		usage("badparm");
+}
+
+
+/*
+ * Field lookups as the getters performed them before the field cache: every
+ * call walks the status tree by member name.
+ */
+std::string lookup_zone_temperature(const evohome::device::zone *zone)
+{
+	Json::Value *jZoneStatus = (*zone).jStatus;
+	return (*jZoneStatus)["temperatureStatus"]["temperature"].asString();
+}
+std::string lookup_zone_setpoint(const evohome::device::zone *zone)
+{
+	Json::Value *jZoneStatus = (*zone).jStatus;
+	return (*jZoneStatus)["setpointStatus"]["targetHeatTemperature"].asString();
+}
+std::string lookup_zone_mode(const evohome::device::zone *zone)
+{
+	Json::Value *jZoneStatus = (*zone).jStatus;
+	return (*jZoneStatus)["setpointStatus"]["setpointMode"].asString();
+}
+
+
+int main(int argc, char** argv)
+{
+	parse_args(argc, argv);
+
+	std::string szPayload;
+	if (payloadfile.empty())
+		szPayload = make_status_payload(numZones);
+	else if (!read_payload(payloadfile, szPayload))
+		exit_error(szERROR+"failed to read payload file '"+payloadfile+"'");
+
+	// attach the status to the zones the same way get_status() does
+	EvohomeClient2 eclient;
+	eclient.m_vLocations.resize(1);
+	evohome::device::location *myLocation = &eclient.m_vLocations[0];
+	Json::CharReaderBuilder jBuilder;
+	std::unique_ptr<Json::CharReader> jReader(jBuilder.newCharReader());
+	std::string szErrors;
+	if (!jReader->parse(szPayload.c_str(), szPayload.c_str() + szPayload.size(), &(*myLocation).jStatus, &szErrors))
+		exit_error(szERROR+"payload is not valid json: "+szErrors);
+	Json::Value *jTCS = &(*myLocation).jStatus["gateways"][0]["temperatureControlSystems"][0];
+	int l = static_cast<int>((*jTCS)["zones"].size());
+	if (l == 0)
+		exit_error(szERROR+"payload does not contain any zones");
+	(*myLocation).gateways.resize(1);
+	(*myLocation).gateways[0].temperatureControlSystems.resize(1);
+	std::vector<evohome::device::zone> *vZones = &(*myLocation).gateways[0].temperatureControlSystems[0].zones;
+	(*vZones).resize(l);
+	for (int i = 0; i < l; i++)
+	{
+		(*vZones)[i].zoneIdx = static_cast<uint8_t>(i);
+		(*vZones)[i].jStatus = &(*jTCS)["zones"][i];
+	}
+
+	cout << "zones: " << l << ", " << numIterations << " passes per run, 3 fields per zone" << endl;
+
+	// string conversion alone, from fields resolved up front
+	std::vector<const Json::Value*> vFields;
+	for (int i = 0; i < l; i++)
+	{
+		vFields.push_back(&(*(*vZones)[i].jStatus)["temperatureStatus"]["temperature"]);
+		vFields.push_back(&(*(*vZones)[i].jStatus)["setpointStatus"]["targetHeatTemperature"]);
+		vFields.push_back(&(*(*vZones)[i].jStatus)["setpointStatus"]["setpointMode"]);
+	}
+
+	// best of several runs to reduce the influence of other load
+	double dConvert = 0;
+	double dLookup = 0;
+	double dCached = 0;
+	size_t numChars = 0; // keeps the results alive
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		BenchTimer convertTimer;
+		for (int n = 0; n < numIterations; n++)
+		{
+			for (size_t i = 0; i < vFields.size(); i++)
+				numChars += (*vFields[i]).asString().size();
+		}
+		double dSeconds = convertTimer.seconds();
+		if ((run == 0) || (dSeconds < dConvert))
+			dConvert = dSeconds;
+
+		BenchTimer lookupTimer;
+		for (int n = 0; n < numIterations; n++)
+		{
+			for (int i = 0; i < l; i++)
+			{
+				numChars += lookup_zone_temperature(&(*vZones)[i]).size();
+				numChars += lookup_zone_setpoint(&(*vZones)[i]).size();
+				numChars += lookup_zone_mode(&(*vZones)[i]).size();
+			}
+		}
+		dSeconds = lookupTimer.seconds();
+		if ((run == 0) || (dSeconds < dLookup))
+			dLookup = dSeconds;
+
+		BenchTimer cachedTimer;
+		for (int n = 0; n < numIterations; n++)
+		{
+			for (int i = 0; i < l; i++)
+			{
+				numChars += eclient.get_zone_temperature(&(*vZones)[i]).size();
+				numChars += eclient.get_zone_setpoint(&(*vZones)[i]).size();
+				numChars += eclient.get_zone_mode(&(*vZones)[i]).size();
+			}
+		}
+		dSeconds = cachedTimer.seconds();
+		if ((run == 0) || (dSeconds < dCached))
+			dCached = dSeconds;
+	}
+
+	double numCalls = 3.0 * l * numIterations;
+	double dFloor = dConvert * 1e9 / numCalls;
+	printf("string conversion:   %7.1f ns/call\n", dFloor);
+	printf("member name lookups: %7.1f ns/call  (%.1f ns lookup)\n", dLookup * 1e9 / numCalls, dLookup * 1e9 / numCalls - dFloor);
+	printf("field cache:         %7.1f ns/call  (%.1f ns lookup)\n", dCached * 1e9 / numCalls, dCached * 1e9 / numCalls - dFloor);
+	printf("speedup: %.2fx (%zu)\n", dLookup / dCached, numChars);
+	return 0;
+}
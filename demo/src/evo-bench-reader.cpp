@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Benchmark for json reader throughput and the block scanning helpers
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include "jsoncpp/json.h"
+#include "jsoncpp/scan.h"
+#include "common/JsonSaxReader.hpp"
+#include "bench-payload.hpp"
+
+
+using namespace std;
+
+
+std::string payloadfile;
+int numZones = 12;
+int numIterations = 1000;
+
+std::string szERROR = "ERROR: ";
+
+
+
+
+void exit_error(std::string message)
+{
+	cerr << message << endl;
+	exit(1);
+}
+
+
+void usage(std::string mode)
+{
+	if (mode == "badparm")
+	{
+		cout << "Bad parameter" << endl;
+		exit(1);
+	}
+	if (mode == "short")
+	{
+		cout << "Usage: evo-bench-reader [-h] [-f file] [-z zones] [-n count]" << endl;
+		cout << "Type \"evo-bench-reader --help\" for more help" << endl;
+		exit(0);
+	}
+	cout << "Usage: evo-bench-reader [OPTIONS]" << endl;
+	cout << endl;
+	cout << "  -f, --file=FILE         parse recorded response FILE instead of a generated status" << endl;
+	cout << "  -z, --zones=NUM         number of zones in the generated status (default 12)" << endl;
+	cout << "  -n, --count=NUM         number of parses per run (default 1000)" << endl;
+	cout << "  -h, --help              display this help and exit" << endl;
+	exit(0);
+}
+
+
+void parse_args(int argc, char** argv) {
+	int i=1;
+	std::string word;
+	while (i < argc) {
+		word = argv[i];
+		if (word.length() > 1 && word[0] == '-' && word[1] != '-') {
+			for (size_t j=1;j<word.length();j++) {
+				if (word[j] == 'h') {
+					usage("short");
+				} else if ((word[j] == 'f') || (word[j] == 'z') || (word[j] == 'n')) {
+					if ((j+1 < word.length()) || (i+1 >= argc))
+						usage("badparm");
+					i++;
+					if (word[j] == 'f')
+						payloadfile = argv[i];
+					else if (word[j] == 'z')
+						numZones = atoi(argv[i]);
+					else
+						numIterations = atoi(argv[i]);
+				} else {
+					usage("badparm");
+				}
+			}
+		} else if (word == "--help") {
+			usage("long");
+		} else if (word.substr(0,7) == "--file=") {
+			payloadfile = word.substr(7);
+		} else if (word.substr(0,8) == "--zones=") {
+			numZones = atoi(word.substr(8).c_str());
+		} else if (word.substr(0,8) == "--count=") {
+			numIterations = atoi(word.substr(8).c_str());
+		} else {
+			usage("badparm");
+		}
+		i++;
+	}
+	if ((numZones < 1) || (numIterations < 1))
+		usage("badparm");
+}
+
+
+/*
+ * Receives all events and ignores them
+ */
+class NullHandler : public JsonSaxReader::Handler
+{
+public:
+	bool key(const char *, const size_t) { return true; }
+	void start_object() {}
+	void end_object() {}
+	void start_array() {}
+	void end_array() {}
+	void string_value(const char *, const size_t) {}
+	void number_value(const char *, const size_t) {}
+	void bool_value(const bool) {}
+	void null_value() {}
+};
+
+
+/*
+ * Character loops as the reader used them before block scanning
+ */
+const char *scalar_skip_whitespace(const char *p, const char *end)
+{
+	while ((p != end) && Json::Scan::isWhitespace(*p))
+		p++;
+	return p;
+}
+const char *scalar_find_quote_or_escape(const char *p, const char *end)
+{
+	while ((p != end) && (*p != '"') && (*p != '\\'))
+		p++;
+	return p;
+}
+const char *scalar_skip_plain_ascii(const char *p, const char *end)
+{
+	while ((p != end) && !Json::Scan::isSpecial(*p))
+		p++;
+	return p;
+}
+
+
+/*
+ * Walk the whole buffer with a scanning function, stepping over each stop
+ */
+size_t scan_buffer(const std::string &szPayload, const char *(*fScan)(const char*, const char*), double &dBest)
+{
+	size_t numStops = 0;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		BenchTimer timer;
+		for (int n = 0; n < numIterations; n++)
+		{
+			const char *p = szPayload.c_str();
+			const char *end = p + szPayload.size();
+			while (p != end)
+			{
+				p = fScan(p, end);
+				if (p != end)
+				{
+					p++;
+					numStops++;
+				}
+			}
+		}
+		double dSeconds = timer.seconds();
+		if ((run == 0) || (dSeconds < dBest))
+			dBest = dSeconds;
+	}
+	return numStops;
+}
+
+
+void bench_scan(const std::string &szName, const std::string &szPayload, const char *(*fBlock)(const char*, const char*), const char *(*fScalar)(const char*, const char*))
+{
+	double dBlock = 0;
+	double dScalar = 0;
+	size_t numStops = scan_buffer(szPayload, fBlock, dBlock);
+	if (scan_buffer(szPayload, fScalar, dScalar) != numStops)
+		exit_error(szERROR+"block and scalar "+szName+" disagree");
+	double dMB = static_cast<double>(szPayload.size()) * numIterations / 1e6;
+	printf("  %-22s block %7.0f MB/s  scalar %7.0f MB/s  %.2fx\n", szName.c_str(), dMB / dBlock, dMB / dScalar, dScalar / dBlock);
+}
+
+
+void bench_parse(const std::string &szName, const std::string &szPayload)
+{
+	Json::CharReaderBuilder jBuilder;
+	std::unique_ptr<Json::CharReader> jReader(jBuilder.newCharReader());
+	const char *begin = szPayload.c_str();
+	const char *end = begin + szPayload.size();
+	std::string szErrors;
+	NullHandler handler;
+
+	double dReader = 0;
+	double dSax = 0;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		BenchTimer readerTimer;
+		for (int n = 0; n < numIterations; n++)
+		{
+			Json::Value jRoot;
+			if (!jReader->parse(begin, end, &jRoot, &szErrors))
+				exit_error(szERROR+"payload is not valid json: "+szErrors);
+		}
+		double dSeconds = readerTimer.seconds();
+		if ((run == 0) || (dSeconds < dReader))
+			dReader = dSeconds;
+
+		BenchTimer saxTimer;
+		for (int n = 0; n < numIterations; n++)
+		{
+			if (!JsonSaxReader::parse(begin, end, handler))
+				exit_error(szERROR+"payload rejected by JsonSaxReader");
+		}
+		dSeconds = saxTimer.seconds();
+		if ((run == 0) || (dSeconds < dSax))
+			dSax = dSeconds;
+	}
+	double dMB = static_cast<double>(szPayload.size()) * numIterations / 1e6;
+	printf("  %-22s CharReader %7.1f MB/s  JsonSaxReader %7.1f MB/s\n", szName.c_str(), dMB / dReader, dMB / dSax);
+}
+
+
+int main(int argc, char** argv)
+{
+	parse_args(argc, argv);
+
+	std::string szPayload;
+	if (payloadfile.empty())
+		szPayload = make_status_payload(numZones);
+	else if (!read_payload(payloadfile, szPayload))
+		exit_error(szERROR+"failed to read payload file '"+payloadfile+"'");
+
+	// the same content with indentation, as written by the styled writers
+	Json::CharReaderBuilder jBuilder;
+	std::unique_ptr<Json::CharReader> jReader(jBuilder.newCharReader());
+	Json::Value jRoot;
+	std::string szErrors;
+	if (!jReader->parse(szPayload.c_str(), szPayload.c_str() + szPayload.size(), &jRoot, &szErrors))
+		exit_error(szERROR+"payload is not valid json: "+szErrors);
+	std::string szIndented;
+	Json::BufferWriter("\t").write(jRoot, szIndented);
+
+#if defined(JSONCPP_SCAN_AVX2)
+	cout << "block scanning: AVX2" << endl;
+#elif defined(JSONCPP_SCAN_SSE2)
+	cout << "block scanning: SSE2" << endl;
+#else
+	cout << "block scanning: none (scalar fallback)" << endl;
+#endif
+	cout << "payload: " << szPayload.size() << " bytes compact, " << szIndented.size() << " bytes indented, " << numIterations << " passes per run" << endl;
+
+	cout << "scanning helpers" << endl;
+	bench_scan("quote/escape compact", szPayload, Json::Scan::findQuoteOrEscape, scalar_find_quote_or_escape);
+	bench_scan("plain ascii compact", szPayload, Json::Scan::skipPlainAscii, scalar_skip_plain_ascii);
+	bench_scan("whitespace indented", szIndented, Json::Scan::skipWhitespace, scalar_skip_whitespace);
+
+	cout << "full parse" << endl;
+	bench_parse("compact", szPayload);
+	bench_parse("indented", szIndented);
+	return 0;
+}
@@ -312,7 +312,7 @@ void cmd_backup_and_restore_schedules()
 {
 	// connect to Evohome server
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	authorize_to_server(eclient);
 
 	// retrieve Evohome installation
@@ -372,7 +372,7 @@ std::string format_time(std::string utc_time)
 void cancel_temperature_override()
 {
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	authorize_to_server(eclient);
 
 	if ( ! eclient.cancel_temperature_override(parameters[1]) )
@@ -399,7 +399,7 @@ void cmd_set_temperature()
 
 
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	authorize_to_server(eclient);
 
 	log("set target temperature");
@@ -421,7 +421,7 @@ void cmd_set_system_mode()
 	if (parameters.size() == 2)
 		until = format_time(parameters[2]);
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	authorize_to_server(eclient);
 
 	if ( evoconfig.find("systemId") != evoconfig.end() ) {
@@ -462,7 +462,7 @@ void cmd_set_dhw_state()
 		s_until = format_time(parameters[3]);
 
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	authorize_to_server(eclient);
 
 	log("set domestic hot water state");
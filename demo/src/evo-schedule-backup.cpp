@@ -30,6 +30,8 @@ std::string configfile;
 
 bool dobackup = true;
 bool verbose;
+bool dodiff;
+bool dryrun;
 
 
 std::string szERROR = "ERROR: ";
@@ -53,13 +55,15 @@ void usage(std::string mode)
 	}
 	if (mode == "short")
 	{
-		cout << "Usage: evo-schedule-backup [-hrv] [-c file] [-f file]" << endl;
+		cout << "Usage: evo-schedule-backup [-hrdnv] [-c file] [-f file]" << endl;
 		cout << "Type \"evo-schedule-backup --help\" for more help" << endl;
 		exit(0);
 	}
 	cout << "Usage: evo-schedule-backup [OPTIONS]" << endl;
 	cout << endl;
 	cout << "  -r, --restore           restore a previous backup" << endl;
+	cout << "  -d, --diff              only restore schedules that differ from the controller" << endl;
+	cout << "  -n, --dry-run           show which schedules differ without restoring them" << endl;
 	cout << "  -v, --verbose           print a lot of information" << endl;
 	cout << "  -c, --conf=FILE         use FILE for server settings and credentials" << endl;
 	cout << "  -f, --file=FILE         use FILE for backup and restore" << endl;
@@ -80,6 +84,13 @@ void parse_args(int argc, char** argv) {
 					exit(0);
 				} else if (word[j] == 'r') {
 					dobackup = false;
+				} else if (word[j] == 'd') {
+					dobackup = false;
+					dodiff = true;
+				} else if (word[j] == 'n') {
+					dobackup = false;
+					dodiff = true;
+					dryrun = true;
 				} else if (word[j] == 'v') {
 					verbose = true;
 				} else if (word[j] == 'c') {
@@ -102,6 +113,13 @@ void parse_args(int argc, char** argv) {
 			exit(0);
 		} else if (word == "--restore") {
 			dobackup = false;
+		} else if (word == "--diff") {
+			dobackup = false;
+			dodiff = true;
+		} else if (word == "--dry-run") {
+			dobackup = false;
+			dodiff = true;
+			dryrun = true;
 		} else if (word == "--verbose") {
 			verbose = true;
 		} else if (word.substr(0,7) == "--conf=") {
@@ -135,7 +153,7 @@ int main(int argc, char** argv)
 
 // connect to Evohome server
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	if (eclient.load_auth_from_file(AUTH_FILE_V2))
 		log("    reusing saved connection (UK/EMEA)");
 	else
@@ -160,6 +178,33 @@ int main(int argc, char** argv)
 			exit_error(szERROR+"failed to open backup file '"+backupfile+"'");
 		cout << "Done!\n";
 	}
+	else if (dodiff)	// differential restore
+	{
+		cout << "Compare Evohome schedules with backup\n";
+		std::vector<evohome::schedule::restore_item> vReport;
+		bool bResult = eclient.schedules_restore(backupfile, vReport, dryrun);
+		if (vReport.empty() && !bResult)
+			exit_error(szERROR+"failed to open backup file '"+backupfile+"'");
+		for (size_t i = 0; i < vReport.size(); i++)
+		{
+			std::string szName = (vReport[i].bDHW) ? "Hot water" : vReport[i].szName;
+			cout << "  " << szName << " (" << vReport[i].szZoneId << "): ";
+			if (!vReport[i].bChanged && !vReport[i].szError.empty())
+				cout << "not compared";
+			else if (!vReport[i].bChanged)
+				cout << "unchanged";
+			else if (dryrun)
+				cout << "differs";
+			else if (vReport[i].bRestored)
+				cout << "restored";
+			else
+				cout << "restore failed";
+			if (!vReport[i].szError.empty())
+				cout << " - " << vReport[i].szError;
+			cout << "\n";
+		}
+		cout << "Done!\n";
+	}
 	else		// restore
 	{
 		cout << "Start restore of Evohome schedules\n";
@@ -176,7 +176,7 @@ int main(int argc, char** argv)
 	read_evoconfig();
 
 	log("connect to Evohome server");
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 	if (eclient.load_auth_from_file(AUTH_FILE_V2))
 		log("    reusing saved connection (UK/EMEA)");
 	else
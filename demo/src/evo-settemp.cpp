@@ -133,7 +133,7 @@ int main(int argc, char** argv)
 	if ( ! read_evoconfig() )
 		exit_error(szERROR+"can't read config file");
 
-	EvohomeClient2 eclient = EvohomeClient2();
+	EvohomeClient2 eclient;
 
 	log("connect to Evohome server");
 	if (eclient.load_auth_from_file(AUTH_FILE_V2))
@@ -0,0 +1,127 @@
+// Copyright 2007-2010 Baptiste Lepilleur and The JsonCpp Authors
+// Distributed under MIT license, or public domain if desired and
+// recognized in your jurisdiction.
+// See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
+
+#ifndef JSON_ARENA_H_INCLUDED
+#define JSON_ARENA_H_INCLUDED
+
+#if !defined(JSON_IS_AMALGAMATION)
+#include "config.h"
+#endif // if !defined(JSON_IS_AMALGAMATION)
+
+#include <cstddef>
+#include <memory>
+
+#pragma pack(push, 8)
+
+namespace Json {
+
+/** \brief Monotonic memory region for Value trees.
+ *
+ * While an Arena::Scope is active on a thread, the strings, object keys and
+ * object/array containers that Value allocates on that thread are carved from
+ * the arena. Releasing such memory is a no-op: all of it is returned in one
+ * step when the arena is reset or destroyed.
+ *
+ * Memory that was allocated outside a scope comes from the heap as before, so
+ * trees may freely mix both. The arena must outlive every Value that holds
+ * memory from it.
+ *
+ * \code
+ * Json::Arena arena;
+ * Json::Value root;
+ * {
+ *   Json::Arena::Scope scope(arena);
+ *   reader->parse(begin, end, &root, &errs);
+ * }
+ * ...
+ * root = Json::Value(); // before arena goes out of scope
+ * \endcode
+ */
+class JSON_API Arena {
+public:
+  explicit Arena(size_t blockSize = 16384);
+  ~Arena();
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /// Return all memory to the first block. Invalidates every Value that
+  /// holds memory from this arena.
+  void reset();
+
+  /// Number of allocations served since construction or the last reset().
+  size_t allocationCount() const { return allocations_; }
+  /// Number of bytes handed out since construction or the last reset().
+  size_t bytesUsed() const { return bytes_; }
+
+  /// Direct Value allocations of the current thread to an arena.
+  class JSON_API Scope {
+  public:
+    explicit Scope(Arena& arena);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Arena* previous_;
+  };
+
+  /// Allocate from the arena of the current scope, or the heap if there is
+  /// none. Never returns nullptr.
+  static void* allocate(size_t size);
+  /// Release memory returned by allocate().
+  static void release(void* p);
+
+private:
+  struct Block {
+    Block* next_;
+    size_t size_;
+  };
+
+  void* allocateFromBlocks(size_t size);
+
+  Block* blocks_;
+  char* cursor_;
+  char* end_;
+  size_t blockSize_;
+  size_t allocations_;
+  size_t bytes_;
+};
+
+/// Standard allocator interface on top of Arena::allocate().
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  ArenaAllocator() {}
+  template <typename U> ArenaAllocator(const ArenaAllocator<U>&) {}
+  template <typename U> struct rebind { using other = ArenaAllocator<U>; };
+
+  pointer allocate(size_type n) {
+    return static_cast<pointer>(Arena::allocate(n * sizeof(T)));
+  }
+  void deallocate(pointer p, size_type) { Arena::release(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+  return false;
+}
+
+} // namespace Json
+
+#pragma pack(pop)
+
+#endif // JSON_ARENA_H_INCLUDED
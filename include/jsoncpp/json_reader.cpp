@@ -5,6 +5,7 @@
 // See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
 
 #if !defined(JSON_IS_AMALGAMATION)
+#include "scan.h"
 #include "json_tool.h"
 #include "assertions.h"
 #include "reader.h"
@@ -463,15 +464,7 @@ bool OurReader::readToken(Token& token) {
   return ok;
 }
 
-void OurReader::skipSpaces() {
-  while (current_ != end_) {
-    Char c = *current_;
-    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
-      ++current_;
-    else
-      break;
-  }
-}
+void OurReader::skipSpaces() { current_ = Scan::skipWhitespace(current_, end_); }
 
 void OurReader::skipBom(bool skipBom) {
   // The default behavior is to skip BOM.
@@ -617,15 +610,17 @@ bool OurReader::readNumber(bool checkInf) {
   return true;
 }
 bool OurReader::readString() {
-  Char c = 0;
   while (current_ != end_) {
-    c = getNextChar();
-    if (c == '\\')
-      getNextChar();
-    else if (c == '"')
+    current_ = Scan::findQuoteOrEscape(current_, end_);
+    if (current_ == end_)
       break;
+    if (*current_++ == '"')
+      return true;
+    // skip the escaped character
+    if (current_ != end_)
+      ++current_;
   }
-  return c == '"';
+  return false;
 }
 
 bool OurReader::readStringSingleQuote() {
@@ -874,6 +869,12 @@ bool OurReader::decodeString(Token& token, String& decoded) {
   Location current = token.start_ + 1; // skip '"'
   Location end = token.end_ - 1;       // do not include '"'
   while (current != end) {
+    // copy the run up to the next quote or escape in one step
+    Location run = Scan::findQuoteOrEscape(current, end);
+    decoded.append(current, run);
+    current = run;
+    if (current == end)
+      break;
     Char c = *current++;
     if (c == '"')
       break;
@@ -118,11 +118,7 @@ static inline char* duplicateStringValue(const char* value, size_t length) {
   if (length >= static_cast<size_t>(Value::maxInt))
     length = Value::maxInt - 1;
 
-  auto newString = static_cast<char*>(malloc(length + 1));
-  if (newString == nullptr) {
-    throwRuntimeError("in Json::Value::duplicateStringValue(): "
-                      "Failed to allocate string value buffer");
-  }
+  auto newString = static_cast<char*>(Arena::allocate(length + 1));
   memcpy(newString, value, length);
   newString[length] = 0;
   return newString;
@@ -139,11 +135,7 @@ static inline char* duplicateAndPrefixStringValue(const char* value,
                       "in Json::Value::duplicateAndPrefixStringValue(): "
                       "length too big for prefixing");
   size_t actualLength = sizeof(length) + length + 1;
-  auto newString = static_cast<char*>(malloc(actualLength));
-  if (newString == nullptr) {
-    throwRuntimeError("in Json::Value::duplicateAndPrefixStringValue(): "
-                      "Failed to allocate string value buffer");
-  }
+  auto newString = static_cast<char*>(Arena::allocate(actualLength));
   *reinterpret_cast<unsigned*>(newString) = length;
   memcpy(newString + sizeof(unsigned), value, length);
   newString[actualLength - 1U] =
@@ -170,19 +162,128 @@ static inline void releasePrefixedStringValue(char* value) {
   decodePrefixedString(true, value, &length, &valueDecoded);
   size_t const size = sizeof(unsigned) + length + 1U;
   memset(value, 0, size);
-  free(value);
+  Arena::release(value);
 }
 static inline void releaseStringValue(char* value, unsigned length) {
   // length==0 => we allocated the strings memory
   size_t size = (length == 0) ? strlen(value) : length;
   memset(value, 0, size);
-  free(value);
+  Arena::release(value);
 }
 #else  // !JSONCPP_USING_SECURE_MEMORY
-static inline void releasePrefixedStringValue(char* value) { free(value); }
-static inline void releaseStringValue(char* value, unsigned) { free(value); }
+static inline void releasePrefixedStringValue(char* value) {
+  Arena::release(value);
+}
+static inline void releaseStringValue(char* value, unsigned) {
+  Arena::release(value);
+}
 #endif // JSONCPP_USING_SECURE_MEMORY
 
+static inline Value::ObjectValues*
+newObjectValues(const Value::ObjectValues* other) {
+  void* p = Arena::allocate(sizeof(Value::ObjectValues));
+  if (other == nullptr)
+    return new (p) Value::ObjectValues();
+  return new (p) Value::ObjectValues(*other);
+}
+
+static inline void releaseObjectValues(Value::ObjectValues* map) {
+  map->~map();
+  Arena::release(map);
+}
+
+// //////////////////////////////////////////////////////////////////
+// class Arena
+// //////////////////////////////////////////////////////////////////
+
+// Every allocation is preceded by a pointer to the arena that owns it, or
+// nullptr if it came from the heap. This keeps release() correct for trees
+// that mix both.
+static const size_t arenaHeaderSize = 8;
+static_assert(sizeof(Arena*) <= arenaHeaderSize,
+              "arena header must hold a pointer");
+
+static thread_local Arena* currentArena = nullptr;
+
+Arena::Arena(size_t blockSize)
+    : blocks_(nullptr), cursor_(nullptr), end_(nullptr),
+      blockSize_(blockSize), allocations_(0), bytes_(0) {}
+
+Arena::~Arena() {
+  while (blocks_ != nullptr) {
+    Block* next = blocks_->next_;
+    free(blocks_);
+    blocks_ = next;
+  }
+}
+
+void Arena::reset() {
+  if (blocks_ == nullptr)
+    return;
+  // keep the oldest block for reuse
+  while (blocks_->next_ != nullptr) {
+    Block* next = blocks_->next_;
+    free(blocks_);
+    blocks_ = next;
+  }
+  cursor_ = reinterpret_cast<char*>(blocks_) + sizeof(Block);
+  end_ = reinterpret_cast<char*>(blocks_) + blocks_->size_;
+  allocations_ = 0;
+  bytes_ = 0;
+}
+
+void* Arena::allocateFromBlocks(size_t size) {
+  size = (size + arenaHeaderSize - 1) & ~(arenaHeaderSize - 1);
+  if (cursor_ == nullptr || static_cast<size_t>(end_ - cursor_) < size) {
+    size_t blockSize = sizeof(Block) + size;
+    if (blockSize < blockSize_)
+      blockSize = blockSize_;
+    auto block = static_cast<Block*>(malloc(blockSize));
+    if (block == nullptr)
+      throwRuntimeError("in Json::Arena::allocate(): "
+                        "Failed to allocate arena block");
+    block->next_ = blocks_;
+    block->size_ = blockSize;
+    blocks_ = block;
+    cursor_ = reinterpret_cast<char*>(block) + sizeof(Block);
+    end_ = reinterpret_cast<char*>(block) + blockSize;
+  }
+  void* p = cursor_;
+  cursor_ += size;
+  return p;
+}
+
+void* Arena::allocate(size_t size) {
+  Arena* arena = currentArena;
+  char* p;
+  if (arena != nullptr) {
+    p = static_cast<char*>(arena->allocateFromBlocks(arenaHeaderSize + size));
+    arena->allocations_++;
+    arena->bytes_ += size;
+  } else {
+    p = static_cast<char*>(malloc(arenaHeaderSize + size));
+    if (p == nullptr)
+      throwRuntimeError("in Json::Arena::allocate(): "
+                        "Failed to allocate value buffer");
+  }
+  *reinterpret_cast<Arena**>(p) = arena;
+  return p + arenaHeaderSize;
+}
+
+void Arena::release(void* p) {
+  if (p == nullptr)
+    return;
+  char* base = static_cast<char*>(p) - arenaHeaderSize;
+  if (*reinterpret_cast<Arena**>(base) == nullptr)
+    free(base);
+}
+
+Arena::Scope::Scope(Arena& arena) : previous_(currentArena) {
+  currentArena = &arena;
+}
+
+Arena::Scope::~Scope() { currentArena = previous_; }
+
 } // namespace Json
 
 // //////////////////////////////////////////////////////////////////
@@ -363,7 +464,7 @@ Value::Value(ValueType type) {
     break;
   case arrayValue:
   case objectValue:
-    value_.map_ = new ObjectValues();
+    value_.map_ = newObjectValues(nullptr);
     break;
   case booleanValue:
     value_.bool_ = false;
@@ -998,7 +1099,7 @@ void Value::dupPayload(const Value& other) {
     break;
   case arrayValue:
   case objectValue:
-    value_.map_ = new ObjectValues(*other.value_.map_);
+    value_.map_ = newObjectValues(other.value_.map_);
     break;
   default:
     JSON_ASSERT_UNREACHABLE;
@@ -1019,7 +1120,7 @@ void Value::releasePayload() {
     break;
   case arrayValue:
   case objectValue:
-    delete value_.map_;
+    releaseObjectValues(value_.map_);
     break;
   default:
     JSON_ASSERT_UNREACHABLE;
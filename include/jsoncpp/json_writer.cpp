@@ -4,6 +4,7 @@
 // See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
 
 #if !defined(JSON_IS_AMALGAMATION)
+#include "scan.h"
 #include "json_tool.h"
 #include "writer.h"
 #endif // if !defined(JSON_IS_AMALGAMATION)
@@ -180,9 +181,7 @@ String valueToString(bool value) { return value ? "true" : "false"; }
 static bool doesAnyCharRequireEscaping(char const* s, size_t n) {
   assert(s || !n);
 
-  return std::any_of(s, s + n, [](unsigned char c) {
-    return c == '\\' || c == '"' || c < 0x20 || c > 0x7F;
-  });
+  return Scan::skipPlainAscii(s, s + n) != s + n;
 }
 
 static unsigned int utf8ToCodepoint(const char*& s, const char* e) {
@@ -353,6 +352,182 @@ String valueToQuotedString(const char* value) {
   return valueToQuotedStringN(value, strlen(value));
 }
 
+void appendNumber(LargestInt value, String& out) {
+  UIntToStringBuffer buffer;
+  char* current = buffer + sizeof(buffer);
+  if (value == Value::minLargestInt) {
+    uintToString(LargestUInt(Value::maxLargestInt) + 1, current);
+    *--current = '-';
+  } else if (value < 0) {
+    uintToString(LargestUInt(-value), current);
+    *--current = '-';
+  } else {
+    uintToString(LargestUInt(value), current);
+  }
+  out.append(current, static_cast<size_t>(buffer + sizeof(buffer) - 1 - current));
+}
+
+void appendNumber(LargestUInt value, String& out) {
+  UIntToStringBuffer buffer;
+  char* current = buffer + sizeof(buffer);
+  uintToString(value, current);
+  out.append(current, static_cast<size_t>(buffer + sizeof(buffer) - 1 - current));
+}
+
+void appendNumber(double value, String& out) {
+  if (!isfinite(value)) {
+    out += isnan(value) ? "null" : (value < 0) ? "-1e+9999" : "1e+9999";
+    return;
+  }
+
+  // Values with only a few decimals, such as temperatures, are written exactly
+  // from their scaled integer: if m / 10^k gives back the same double, then so
+  // does reading the decimal string, and trying k upwards gives the shortest.
+  static const double powersOf10[7] = {1.0,    10.0,    100.0,    1000.0,
+                                       10000.0, 100000.0, 1000000.0};
+  double absValue = std::fabs(value);
+  if (absValue < 1e15) {
+    for (unsigned int k = 0; k < 7; k++) {
+      double scaled = std::floor(absValue * powersOf10[k] + 0.5);
+      if (scaled >= 9007199254740992.0) // 2^53
+        break;
+      if (scaled / powersOf10[k] != absValue)
+        continue;
+
+      UIntToStringBuffer buffer;
+      char* current = buffer + sizeof(buffer);
+      uintToString(static_cast<LargestUInt>(scaled), current);
+      size_t digits =
+          static_cast<size_t>(buffer + sizeof(buffer) - 1 - current);
+      if (std::signbit(value))
+        out += '-';
+      if (k == 0) {
+        out.append(current, digits);
+        out += ".0";
+      } else if (digits > k) {
+        out.append(current, digits - k);
+        out += '.';
+        out.append(current + digits - k, k);
+      } else {
+        out += "0.";
+        out.append(k - digits, '0');
+        out.append(current, digits);
+      }
+      return;
+    }
+  }
+
+  // Otherwise use the fewest significant digits that read back the same.
+  char buffer[36];
+  int len = 0;
+  for (int precision = 15; precision <= 17; precision++) {
+    len = jsoncpp_snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if (precision == 17 || strtod(buffer, nullptr) == value)
+      break;
+  }
+  char* end = fixNumericLocale(buffer, buffer + len);
+  out.append(buffer, static_cast<size_t>(end - buffer));
+  if (std::find(buffer, end, '.') == end && std::find(buffer, end, 'e') == end)
+    out += ".0";
+}
+
+void appendQuotedString(const char* value, size_t length, String& out) {
+  if (!doesAnyCharRequireEscaping(value, length)) {
+    out += '"';
+    out.append(value, length);
+    out += '"';
+    return;
+  }
+  out += valueToQuotedStringN(value, length);
+}
+
+// Class BufferWriter
+// //////////////////////////////////////////////////////////////////
+
+BufferWriter::BufferWriter(String indentation)
+    : indentation_(std::move(indentation)) {}
+
+void BufferWriter::write(const Value& root, String& out) const {
+  writeValue(root, out, 0);
+}
+
+void BufferWriter::writeValue(const Value& value, String& out,
+                              unsigned int depth) const {
+  switch (value.type()) {
+  case nullValue:
+    out += "null";
+    break;
+  case intValue:
+    appendNumber(value.asLargestInt(), out);
+    break;
+  case uintValue:
+    appendNumber(value.asLargestUInt(), out);
+    break;
+  case realValue:
+    appendNumber(value.asDouble(), out);
+    break;
+  case stringValue: {
+    char const* str;
+    char const* end;
+    if (value.getString(&str, &end))
+      appendQuotedString(str, static_cast<size_t>(end - str), out);
+    else
+      out += "\"\"";
+    break;
+  }
+  case booleanValue:
+    out += value.asBool() ? "true" : "false";
+    break;
+  case arrayValue: {
+    ArrayIndex size = value.size();
+    if (size == 0) {
+      out += "[]";
+      break;
+    }
+    out += '[';
+    for (ArrayIndex index = 0; index < size; ++index) {
+      if (index > 0)
+        out += ',';
+      writeNewline(out, depth + 1);
+      writeValue(value[index], out, depth + 1);
+    }
+    writeNewline(out, depth);
+    out += ']';
+    break;
+  }
+  case objectValue: {
+    if (value.empty()) {
+      out += "{}";
+      break;
+    }
+    out += '{';
+    bool first = true;
+    for (Value::const_iterator it = value.begin(); it != value.end(); ++it) {
+      if (!first)
+        out += ',';
+      first = false;
+      writeNewline(out, depth + 1);
+      char const* end;
+      char const* name = it.memberName(&end);
+      appendQuotedString(name, static_cast<size_t>(end - name), out);
+      out += indentation_.empty() ? ":" : " : ";
+      writeValue(*it, out, depth + 1);
+    }
+    writeNewline(out, depth);
+    out += '}';
+    break;
+  }
+  }
+}
+
+void BufferWriter::writeNewline(String& out, unsigned int depth) const {
+  if (indentation_.empty())
+    return;
+  out += '\n';
+  for (unsigned int i = 0; i < depth; i++)
+    out += indentation_;
+}
+
 // Class Writer
 // //////////////////////////////////////////////////////////////////
 Writer::~Writer() = default;
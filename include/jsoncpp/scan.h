@@ -0,0 +1,191 @@
+// Copyright 2007-2010 Baptiste Lepilleur and The JsonCpp Authors
+// Distributed under MIT license, or public domain if desired and
+// recognized in your jurisdiction.
+// See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
+
+#ifndef JSON_SCAN_H_INCLUDED
+#define JSON_SCAN_H_INCLUDED
+
+/* This header provides the character scanning loops used by the reader and
+ * writer: skipping whitespace, finding the end of a plain string run and
+ * checking whether a string needs escaping.
+ *
+ * With SSE2 (default on x86-64) or AVX2 (-mavx2) available at compile time the
+ * input is examined 16 or 32 bytes at a time; otherwise, or when
+ * JSONCPP_NO_SIMD is defined, a plain character loop is used. All variants
+ * return the same result and never read outside [p, end).
+ *
+ * The functions only depend on the input range, so other parsers may use them
+ * too. Like the rest of the library, the instruction set is fixed when the
+ * including translation unit is compiled.
+ */
+
+#if !defined(JSONCPP_NO_SIMD)
+#if defined(__AVX2__)
+#define JSONCPP_SCAN_AVX2 1
+#define JSONCPP_SCAN_SSE2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONCPP_SCAN_SSE2 1
+#include <emmintrin.h>
+#endif
+#endif // if !defined(JSONCPP_NO_SIMD)
+
+#if defined(JSONCPP_SCAN_SSE2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Json {
+namespace Scan {
+
+#if defined(JSONCPP_SCAN_SSE2)
+/// Index of the lowest set bit of a non-zero mask.
+static inline unsigned int lowestBit(unsigned int mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned int>(index);
+#else
+  return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+static inline __m128i load16(const char* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline unsigned int whitespaceMask16(__m128i v) {
+  __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+  return static_cast<unsigned int>(_mm_movemask_epi8(ws));
+}
+
+static inline unsigned int quoteOrEscapeMask16(__m128i v) {
+  return static_cast<unsigned int>(
+      _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')))));
+}
+
+// Signed compare: bytes >= 0x80 are negative and therefore also below 0x20.
+static inline unsigned int specialMask16(__m128i v) {
+  return static_cast<unsigned int>(_mm_movemask_epi8(
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                   _mm_cmplt_epi8(v, _mm_set1_epi8(0x20)))));
+}
+#endif // if defined(JSONCPP_SCAN_SSE2)
+
+#if defined(JSONCPP_SCAN_AVX2)
+static inline __m256i load32(const char* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+static inline unsigned int whitespaceMask32(__m256i v) {
+  __m256i ws = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+  return static_cast<unsigned int>(_mm256_movemask_epi8(ws));
+}
+
+static inline unsigned int quoteOrEscapeMask32(__m256i v) {
+  return static_cast<unsigned int>(_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')))));
+}
+
+static inline unsigned int specialMask32(__m256i v) {
+  return static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v))));
+}
+#endif // if defined(JSONCPP_SCAN_AVX2)
+
+static inline bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool isSpecial(char c) {
+  unsigned char u = static_cast<unsigned char>(c);
+  return u == '"' || u == '\\' || u < 0x20 || u > 0x7F;
+}
+
+/// Return the first character in [p, end) that is not JSON whitespace, or end.
+static inline const char* skipWhitespace(const char* p, const char* end) {
+  // Most runs are empty or a single separator; only go wide for indentation.
+  if (p == end || !isWhitespace(*p))
+    return p;
+  ++p;
+#if defined(JSONCPP_SCAN_AVX2)
+  for (; end - p >= 32; p += 32) {
+    unsigned int mask = ~whitespaceMask32(load32(p));
+    if (mask)
+      return p + lowestBit(mask);
+  }
+#endif
+#if defined(JSONCPP_SCAN_SSE2)
+  for (; end - p >= 16; p += 16) {
+    unsigned int mask = ~whitespaceMask16(load16(p)) & 0xFFFFu;
+    if (mask)
+      return p + lowestBit(mask);
+  }
+#endif
+  while (p != end && isWhitespace(*p))
+    ++p;
+  return p;
+}
+
+/// Return the first '"' or '\\' in [p, end), or end.
+static inline const char* findQuoteOrEscape(const char* p, const char* end) {
+#if defined(JSONCPP_SCAN_AVX2)
+  for (; end - p >= 32; p += 32) {
+    unsigned int mask = quoteOrEscapeMask32(load32(p));
+    if (mask)
+      return p + lowestBit(mask);
+  }
+#endif
+#if defined(JSONCPP_SCAN_SSE2)
+  for (; end - p >= 16; p += 16) {
+    unsigned int mask = quoteOrEscapeMask16(load16(p));
+    if (mask)
+      return p + lowestBit(mask);
+  }
+#endif
+  while (p != end && *p != '"' && *p != '\\')
+    ++p;
+  return p;
+}
+
+/// Return the first character in [p, end) that is not plain printable ASCII
+/// or that must be escaped in a JSON string ('"', '\\', control characters
+/// and bytes >= 0x80), or end.
+static inline const char* skipPlainAscii(const char* p, const char* end) {
+#if defined(JSONCPP_SCAN_AVX2)
+  for (; end - p >= 32; p += 32) {
+    unsigned int mask = specialMask32(load32(p));
+    if (mask)
+      return p + lowestBit(mask);
+  }
+#endif
+#if defined(JSONCPP_SCAN_SSE2)
+  for (; end - p >= 16; p += 16) {
+    unsigned int mask = specialMask16(load16(p));
+    if (mask)
+      return p + lowestBit(mask);
+  }
+#endif
+  while (p != end && !isSpecial(*p))
+    ++p;
+  return p;
+}
+
+} // namespace Scan
+} // namespace Json
+
+#endif // JSON_SCAN_H_INCLUDED
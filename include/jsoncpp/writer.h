@@ -342,6 +342,38 @@ private:
 #pragma warning(pop)
 #endif
 
+/** \brief Writes a Value by appending to a caller owned buffer.
+ *
+ * No intermediate strings or streams are used, so a buffer that is cleared
+ * and reused between calls stops reallocating once it has grown. Doubles are
+ * written in the shortest form that reads back to the same value. Comments
+ * are not written.
+ *
+ * With an empty indentation (the default) the output has no whitespace,
+ * otherwise every member and array element is written on its own line.
+ */
+class JSON_API BufferWriter {
+public:
+  explicit BufferWriter(String indentation = String());
+
+  /// Append the serialized root to out.
+  void write(const Value& root, String& out) const;
+
+private:
+  void writeValue(const Value& value, String& out, unsigned int depth) const;
+  void writeNewline(String& out, unsigned int depth) const;
+
+  String indentation_;
+};
+
+/// Append a number to out without intermediate strings. Doubles are written
+/// in their shortest round trip form.
+void JSON_API appendNumber(LargestInt value, String& out);
+void JSON_API appendNumber(LargestUInt value, String& out);
+void JSON_API appendNumber(double value, String& out);
+/// Append a quoted and escaped string to out.
+void JSON_API appendQuotedString(const char* value, size_t length, String& out);
+
 #if defined(JSON_HAS_INT64)
 String JSON_API valueToString(Int value);
 String JSON_API valueToString(UInt value);
@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Event driven json reader for Evohome
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include "JsonSaxReader.hpp"
+#include "jsoncpp/scan.h"
+
+#define JSON_SAX_MAX_DEPTH 256
+
+
+/*
+ * Builds the pruned tree for parse_filtered()
+ *
+ * Every open object or array is kept on a stack together with its filter node.
+ * A node index of -1 means that everything below it is copied.
+ */
+class JsonSaxReader::FilterHandler : public JsonSaxReader::Handler
+{
+public:
+	FilterHandler(const std::vector<JsonSaxReader::filter_node> &vNodes, Json::Value &jOutput) :
+		m_vNodes(vNodes), m_jOutput(jOutput), m_iKeyNode(-1) {}
+
+	bool key(const char *szKey, const size_t len)
+	{
+		int node = m_vStack.back().node;
+		if (node >= 0)
+		{
+			const std::vector<std::pair<std::string, int> > &vChildren = m_vNodes[node].vChildren;
+			size_t i, n = vChildren.size();
+			for (i = 0; i < n; i++)
+			{
+				if ((vChildren[i].first.size() == len) && (memcmp(vChildren[i].first.c_str(), szKey, len) == 0))
+					break;
+			}
+			if (i == n)
+				return false;
+			node = (m_vNodes[vChildren[i].second].bKeepAll) ? -1 : vChildren[i].second;
+		}
+		m_iKeyNode = node;
+		m_szKey.assign(szKey, len);
+		return true;
+	}
+
+	void start_object()
+	{
+		open_container(Json::objectValue);
+	}
+
+	void end_object()
+	{
+		m_vStack.pop_back();
+	}
+
+	void start_array()
+	{
+		open_container(Json::arrayValue);
+	}
+
+	void end_array()
+	{
+		m_vStack.pop_back();
+	}
+
+	void string_value(const char *str, const size_t len)
+	{
+		next_value() = Json::Value(str, str + len);
+	}
+
+	void number_value(const char *str, const size_t len)
+	{
+		Json::Value &jValue = next_value();
+		if ((memchr(str, '.', len) == NULL) && (memchr(str, 'e', len) == NULL) && (memchr(str, 'E', len) == NULL))
+		{
+			// same integer typing as the jsoncpp reader
+			errno = 0;
+			if (str[0] == '-')
+			{
+				long long value = strtoll(str, NULL, 10);
+				if (errno == 0)
+				{
+					jValue = Json::Value(static_cast<Json::LargestInt>(value));
+					return;
+				}
+			}
+			else
+			{
+				unsigned long long value = strtoull(str, NULL, 10);
+				if (errno == 0)
+				{
+					if (value <= static_cast<unsigned long long>(Json::Value::maxLargestInt))
+						jValue = Json::Value(static_cast<Json::LargestInt>(value));
+					else
+						jValue = Json::Value(static_cast<Json::LargestUInt>(value));
+					return;
+				}
+			}
+		}
+		jValue = Json::Value(strtod(str, NULL));
+	}
+
+	void bool_value(const bool bValue)
+	{
+		next_value() = Json::Value(bValue);
+	}
+
+	void null_value()
+	{
+		next_value() = Json::Value();
+	}
+
+private:
+	typedef struct _sFrame
+	{
+		Json::Value *pValue;
+		int node;
+	} frame;
+
+	Json::Value &next_value()
+	{
+		if (m_vStack.empty())
+			return m_jOutput;
+		Json::Value *pParent = m_vStack.back().pValue;
+		if (pParent->isArray())
+			return pParent->append(Json::Value());
+		return (*pParent)[m_szKey];
+	}
+
+	void open_container(const Json::ValueType eType)
+	{
+		int node = 0;
+		if (!m_vStack.empty())
+			node = (m_vStack.back().pValue->isArray()) ? m_vStack.back().node : m_iKeyNode;
+		Json::Value &jValue = next_value();
+		jValue = Json::Value(eType);
+		frame newFrame;
+		newFrame.pValue = &jValue;
+		newFrame.node = node;
+		m_vStack.push_back(newFrame);
+	}
+
+	const std::vector<JsonSaxReader::filter_node> &m_vNodes;
+	Json::Value &m_jOutput;
+	std::vector<frame> m_vStack;
+	std::string m_szKey;
+	int m_iKeyNode;
+};
+
+
+bool JsonSaxReader::parse(const char *begin, const char *end, Handler &handler)
+{
+	std::string szBuffer;
+	const char *p = begin;
+	if (!parse_value(p, end, &handler, szBuffer, 0))
+		return false;
+	skip_whitespace(p, end);
+	return ((p == end) || (*p == '\0'));
+}
+
+
+bool JsonSaxReader::parse_filtered(const std::string &szInput, const std::vector<std::string> &vPaths, Json::Value &jOutput)
+{
+	std::vector<filter_node> vNodes(1);
+	vNodes[0].bKeepAll = false;
+	for (size_t i = 0; i < vPaths.size(); i++)
+	{
+		int node = 0;
+		size_t pos = 0;
+		while (pos <= vPaths[i].size())
+		{
+			size_t next = vPaths[i].find('.', pos);
+			if (next == std::string::npos)
+				next = vPaths[i].size();
+			std::string szName = vPaths[i].substr(pos, next - pos);
+			pos = next + 1;
+
+			int child = -1;
+			for (size_t j = 0; j < vNodes[node].vChildren.size(); j++)
+			{
+				if (vNodes[node].vChildren[j].first == szName)
+					child = vNodes[node].vChildren[j].second;
+			}
+			if (child < 0)
+			{
+				child = static_cast<int>(vNodes.size());
+				vNodes.push_back(filter_node());
+				vNodes[child].bKeepAll = false;
+				vNodes[node].vChildren.push_back(std::make_pair(szName, child));
+			}
+			node = child;
+		}
+		if (node > 0)
+			vNodes[node].bKeepAll = true;
+	}
+
+	jOutput = Json::Value();
+	FilterHandler filter(vNodes, jOutput);
+	return parse(szInput.c_str(), szInput.c_str() + szInput.size(), filter);
+}
+
+
+/*
+ * Parse a single value. With handler set to NULL the value is only validated.
+ */
+/* private */ bool JsonSaxReader::parse_value(const char *&p, const char *end, Handler *handler, std::string &szBuffer, const int depth)
+{
+	if (depth > JSON_SAX_MAX_DEPTH)
+		return false;
+
+	skip_whitespace(p, end);
+	if (p >= end)
+		return false;
+
+	const char *str;
+	size_t len;
+	switch (*p)
+	{
+		case '{':
+			p++;
+			if (handler)
+				handler->start_object();
+			skip_whitespace(p, end);
+			if ((p < end) && (*p == '}'))
+			{
+				p++;
+				if (handler)
+					handler->end_object();
+				return true;
+			}
+			while (true)
+			{
+				skip_whitespace(p, end);
+				if ((p >= end) || (*p != '"'))
+					return false;
+
+				Handler *member = NULL;
+				if (handler)
+				{
+					if (!parse_string(p, end, szBuffer, str, len))
+						return false;
+					if (handler->key(str, len))
+						member = handler;
+				}
+				else if (!skip_string(p, end))
+					return false;
+
+				skip_whitespace(p, end);
+				if ((p >= end) || (*p != ':'))
+					return false;
+				p++;
+				if (!parse_value(p, end, member, szBuffer, depth + 1))
+					return false;
+
+				skip_whitespace(p, end);
+				if (p >= end)
+					return false;
+				if (*p == ',')
+				{
+					p++;
+					continue;
+				}
+				if (*p != '}')
+					return false;
+				p++;
+				if (handler)
+					handler->end_object();
+				return true;
+			}
+
+		case '[':
+			p++;
+			if (handler)
+				handler->start_array();
+			skip_whitespace(p, end);
+			if ((p < end) && (*p == ']'))
+			{
+				p++;
+				if (handler)
+					handler->end_array();
+				return true;
+			}
+			while (true)
+			{
+				if (!parse_value(p, end, handler, szBuffer, depth + 1))
+					return false;
+
+				skip_whitespace(p, end);
+				if (p >= end)
+					return false;
+				if (*p == ',')
+				{
+					p++;
+					continue;
+				}
+				if (*p != ']')
+					return false;
+				p++;
+				if (handler)
+					handler->end_array();
+				return true;
+			}
+
+		case '"':
+			if (!handler)
+				return skip_string(p, end);
+			if (!parse_string(p, end, szBuffer, str, len))
+				return false;
+			handler->string_value(str, len);
+			return true;
+
+		case 't':
+			if (!match_literal(p, end, "true"))
+				return false;
+			if (handler)
+				handler->bool_value(true);
+			return true;
+
+		case 'f':
+			if (!match_literal(p, end, "false"))
+				return false;
+			if (handler)
+				handler->bool_value(false);
+			return true;
+
+		case 'n':
+			if (!match_literal(p, end, "null"))
+				return false;
+			if (handler)
+				handler->null_value();
+			return true;
+
+		default:
+			str = p;
+			if (!scan_number(p, end))
+				return false;
+			if (handler)
+			{
+				// strtod and friends need a terminated string
+				szBuffer.assign(str, p);
+				handler->number_value(szBuffer.c_str(), szBuffer.size());
+			}
+			return true;
+	}
+}
+
+
+/*
+ * Read a string starting at its opening quote
+ *
+ * If the string contains no escapes str points into the input, otherwise the
+ * string is decoded into szBuffer.
+ */
+/* private */ bool JsonSaxReader::parse_string(const char *&p, const char *end, std::string &szBuffer, const char *&str, size_t &len)
+{
+	p++;
+	const char *start = p;
+	p = Json::Scan::findQuoteOrEscape(p, end);
+	if (p >= end)
+		return false;
+	if (*p == '"')
+	{
+		str = start;
+		len = static_cast<size_t>(p - start);
+		p++;
+		return true;
+	}
+
+	szBuffer.assign(start, p);
+	while (p < end)
+	{
+		const char *run = Json::Scan::findQuoteOrEscape(p, end);
+		szBuffer.append(p, run);
+		p = run;
+		if (p >= end)
+			return false;
+		char c = *p++;
+		if (c == '"')
+		{
+			str = szBuffer.c_str();
+			len = szBuffer.size();
+			return true;
+		}
+		if (c != '\\')
+		{
+			szBuffer.append(1, c);
+			continue;
+		}
+		if (p >= end)
+			return false;
+		c = *p++;
+		switch (c)
+		{
+			case '"':
+			case '\\':
+			case '/':
+				szBuffer.append(1, c);
+				break;
+			case 'b':
+				szBuffer.append(1, '\b');
+				break;
+			case 'f':
+				szBuffer.append(1, '\f');
+				break;
+			case 'n':
+				szBuffer.append(1, '\n');
+				break;
+			case 'r':
+				szBuffer.append(1, '\r');
+				break;
+			case 't':
+				szBuffer.append(1, '\t');
+				break;
+			case 'u':
+			{
+				unsigned int codepoint;
+				if (!read_hex4(p, end, codepoint))
+					return false;
+				p += 4;
+				if ((codepoint >= 0xD800) && (codepoint <= 0xDBFF))
+				{
+					// surrogate pair
+					unsigned int low;
+					if ((end - p < 6) || (p[0] != '\\') || (p[1] != 'u') || !read_hex4(p + 2, end, low) || (low < 0xDC00) || (low > 0xDFFF))
+						return false;
+					p += 6;
+					codepoint = 0x10000 + ((codepoint & 0x3FF) << 10) + (low & 0x3FF);
+				}
+				add_utf8(codepoint, szBuffer);
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+	return false;
+}
+
+
+/* private */ bool JsonSaxReader::skip_string(const char *&p, const char *end)
+{
+	p++;
+	while (p < end)
+	{
+		p = Json::Scan::findQuoteOrEscape(p, end);
+		if (p >= end)
+			return false;
+		if (*p == '"')
+		{
+			p++;
+			return true;
+		}
+		if (*p == '\\')
+			p++;
+		p++;
+	}
+	return false;
+}
+
+
+/* private */ bool JsonSaxReader::scan_number(const char *&p, const char *end)
+{
+	if ((p < end) && (*p == '-'))
+		p++;
+	const char *digits = p;
+	while ((p < end) && (*p >= '0') && (*p <= '9'))
+		p++;
+	if (p == digits)
+		return false;
+	if ((p < end) && (*p == '.'))
+	{
+		p++;
+		digits = p;
+		while ((p < end) && (*p >= '0') && (*p <= '9'))
+			p++;
+		if (p == digits)
+			return false;
+	}
+	if ((p < end) && ((*p == 'e') || (*p == 'E')))
+	{
+		p++;
+		if ((p < end) && ((*p == '+') || (*p == '-')))
+			p++;
+		digits = p;
+		while ((p < end) && (*p >= '0') && (*p <= '9'))
+			p++;
+		if (p == digits)
+			return false;
+	}
+	return true;
+}
+
+
+/* private */ bool JsonSaxReader::match_literal(const char *&p, const char *end, const char *szLiteral)
+{
+	size_t len = strlen(szLiteral);
+	if ((static_cast<size_t>(end - p) < len) || (memcmp(p, szLiteral, len) != 0))
+		return false;
+	p += len;
+	return true;
+}
+
+
+/* private */ void JsonSaxReader::skip_whitespace(const char *&p, const char *end)
+{
+	p = Json::Scan::skipWhitespace(p, end);
+}
+
+
+/* private */ void JsonSaxReader::add_utf8(const unsigned int codepoint, std::string &szBuffer)
+{
+	if (codepoint < 0x80)
+		szBuffer.append(1, static_cast<char>(codepoint));
+	else if (codepoint < 0x800)
+	{
+		szBuffer.append(1, static_cast<char>(0xC0 | (codepoint >> 6)));
+		szBuffer.append(1, static_cast<char>(0x80 | (codepoint & 0x3F)));
+	}
+	else if (codepoint < 0x10000)
+	{
+		szBuffer.append(1, static_cast<char>(0xE0 | (codepoint >> 12)));
+		szBuffer.append(1, static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+		szBuffer.append(1, static_cast<char>(0x80 | (codepoint & 0x3F)));
+	}
+	else
+	{
+		szBuffer.append(1, static_cast<char>(0xF0 | (codepoint >> 18)));
+		szBuffer.append(1, static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+		szBuffer.append(1, static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+		szBuffer.append(1, static_cast<char>(0x80 | (codepoint & 0x3F)));
+	}
+}
+
+
+/* private */ bool JsonSaxReader::read_hex4(const char *p, const char *end, unsigned int &value)
+{
+	if (end - p < 4)
+		return false;
+	value = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		char c = p[i];
+		value <<= 4;
+		if ((c >= '0') && (c <= '9'))
+			value += static_cast<unsigned int>(c - '0');
+		else if ((c >= 'a') && (c <= 'f'))
+			value += static_cast<unsigned int>(c - 'a' + 10);
+		else if ((c >= 'A') && (c <= 'F'))
+			value += static_cast<unsigned int>(c - 'A' + 10);
+		else
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Event driven json reader for Evohome
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include "jsoncpp/json.h"
+
+
+class JsonSaxReader
+{
+public:
+
+/*
+ * Receiver for parse events
+ *
+ * Return false from key() to skip the value of that member. A skipped value is
+ * scanned for syntax only: no events are raised and nothing is allocated for it.
+ * String pointers are only valid for the duration of the call.
+ */
+	class Handler
+	{
+	public:
+		virtual ~Handler() {}
+		virtual bool key(const char *szKey, const size_t len) = 0;
+		virtual void start_object() = 0;
+		virtual void end_object() = 0;
+		virtual void start_array() = 0;
+		virtual void end_array() = 0;
+		virtual void string_value(const char *str, const size_t len) = 0;
+		virtual void number_value(const char *str, const size_t len) = 0;
+		virtual void bool_value(const bool bValue) = 0;
+		virtual void null_value() = 0;
+	};
+
+
+/*
+ * Parse json text and send its contents to handler
+ *
+ * Returns false if the input is not valid json. Events that were already sent
+ * before the error was found are not undone.
+ */
+	static bool parse(const char *begin, const char *end, Handler &handler);
+
+
+/*
+ * Parse json text into a tree that only holds the members listed in vPaths
+ *
+ * A path is a dot separated list of member names, e.g. "locations.gateways.gatewayInfo".
+ * Arrays are transparent: the path applies to every element. A member that matches
+ * the end of a path is copied with all of its content. Anything else is skipped.
+ */
+	static bool parse_filtered(const std::string &szInput, const std::vector<std::string> &vPaths, Json::Value &jOutput);
+
+
+private:
+	typedef struct _sFilterNode
+	{
+		std::vector<std::pair<std::string, int> > vChildren; // member name, node index
+		bool bKeepAll;
+	} filter_node;
+
+	class FilterHandler;
+
+	static bool parse_value(const char *&p, const char *end, Handler *handler, std::string &szBuffer, const int depth);
+	static bool parse_string(const char *&p, const char *end, std::string &szBuffer, const char *&str, size_t &len);
+	static bool skip_string(const char *&p, const char *end);
+	static bool scan_number(const char *&p, const char *end);
+	static bool match_literal(const char *&p, const char *end, const char *szLiteral);
+	static void skip_whitespace(const char *&p, const char *end);
+	static void add_utf8(const unsigned int codepoint, std::string &szBuffer);
+	static bool read_hex4(const char *p, const char *end, unsigned int &value);
+
+};
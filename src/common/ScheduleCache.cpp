@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Binary schedule cache for Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include "ScheduleCache.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+#define localtime_r(timep, result) localtime_s(result, timep)
+#endif
+
+
+ScheduleCache::ScheduleCache()
+{
+	m_pData = NULL;
+	m_iSize = 0;
+	m_bMapped = false;
+	m_pHeader = NULL;
+	m_pIndex = NULL;
+	m_pSwitchpoints = NULL;
+}
+
+
+ScheduleCache::~ScheduleCache()
+{
+	close();
+}
+
+
+bool ScheduleCache::write(const std::string &szFilename, const std::vector<evohome::schedule::cache::zone> &vZones)
+{
+	std::vector<const evohome::schedule::cache::zone*> vSorted;
+	for (size_t i = 0; i < vZones.size(); i++)
+	{
+		if (vZones[i].szZoneId.length() < sizeof(evohome::schedule::cache::zone_index::szZoneId))
+			vSorted.push_back(&vZones[i]);
+	}
+	std::sort(vSorted.begin(), vSorted.end(),
+		[](const evohome::schedule::cache::zone *a, const evohome::schedule::cache::zone *b) { return a->szZoneId < b->szZoneId; });
+
+	evohome::schedule::cache::header fileHeader;
+	memset(&fileHeader, 0, sizeof(fileHeader));
+	memcpy(fileHeader.magic, evohome::schedule::cache::magic, sizeof(fileHeader.magic));
+	fileHeader.version = evohome::schedule::cache::version;
+	fileHeader.numZones = static_cast<uint32_t>(vSorted.size());
+	fileHeader.tCreated = static_cast<int64_t>(time(NULL));
+
+	std::vector<evohome::schedule::cache::zone_index> vIndex(vSorted.size());
+	std::vector<evohome::schedule::cache::switchpoint> vSwitchpoints;
+	for (size_t i = 0; i < vSorted.size(); i++)
+	{
+		evohome::schedule::cache::zone_index *zoneIndex = &vIndex[i];
+		memset(zoneIndex, 0, sizeof(evohome::schedule::cache::zone_index));
+		memcpy(zoneIndex->szZoneId, vSorted[i]->szZoneId.c_str(), vSorted[i]->szZoneId.length());
+		zoneIndex->bDHW = (vSorted[i]->bDHW) ? 1 : 0;
+		zoneIndex->firstSwitchpoint = static_cast<uint32_t>(vSwitchpoints.size());
+		for (int day = 0; day < 7; day++)
+		{
+			zoneIndex->dayStart[day] = static_cast<uint16_t>(vSwitchpoints.size() - zoneIndex->firstSwitchpoint);
+			vSwitchpoints.insert(vSwitchpoints.end(), vSorted[i]->vDays[day].begin(), vSorted[i]->vDays[day].end());
+		}
+		zoneIndex->dayStart[7] = static_cast<uint16_t>(vSwitchpoints.size() - zoneIndex->firstSwitchpoint);
+	}
+	fileHeader.numSwitchpoints = static_cast<uint32_t>(vSwitchpoints.size());
+
+	std::string szTempFile = szFilename + ".tmp";
+	std::ofstream myfile (szTempFile.c_str(), std::ofstream::binary | std::ofstream::trunc);
+	if (!myfile.is_open())
+		return false;
+	myfile.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+	if (!vIndex.empty())
+		myfile.write(reinterpret_cast<const char*>(&vIndex[0]), vIndex.size() * sizeof(evohome::schedule::cache::zone_index));
+	if (!vSwitchpoints.empty())
+		myfile.write(reinterpret_cast<const char*>(&vSwitchpoints[0]), vSwitchpoints.size() * sizeof(evohome::schedule::cache::switchpoint));
+	myfile.close();
+	if (myfile.fail())
+	{
+		remove(szTempFile.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	remove(szFilename.c_str());
+#endif
+	return (rename(szTempFile.c_str(), szFilename.c_str()) == 0);
+}
+
+
+bool ScheduleCache::open(const std::string &szFilename)
+{
+	close();
+#ifndef _WIN32
+	int fd = ::open(szFilename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat fileStat;
+	if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size < static_cast<off_t>(sizeof(evohome::schedule::cache::header))))
+	{
+		::close(fd);
+		return false;
+	}
+	void *pMap = mmap(NULL, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (pMap == MAP_FAILED)
+		return false;
+	m_pData = static_cast<const char*>(pMap);
+	m_iSize = static_cast<size_t>(fileStat.st_size);
+	m_bMapped = true;
+#else
+	std::ifstream myfile (szFilename.c_str(), std::ifstream::binary);
+	if (!myfile.is_open())
+		return false;
+	m_vBuffer.assign(std::istreambuf_iterator<char>(myfile), std::istreambuf_iterator<char>());
+	if (m_vBuffer.size() < sizeof(evohome::schedule::cache::header))
+	{
+		std::vector<char>().swap(m_vBuffer);
+		return false;
+	}
+	m_pData = &m_vBuffer[0];
+	m_iSize = m_vBuffer.size();
+#endif
+
+	m_pHeader = reinterpret_cast<const evohome::schedule::cache::header*>(m_pData);
+	size_t expectedSize = sizeof(evohome::schedule::cache::header) +
+				static_cast<size_t>(m_pHeader->numZones) * sizeof(evohome::schedule::cache::zone_index) +
+				static_cast<size_t>(m_pHeader->numSwitchpoints) * sizeof(evohome::schedule::cache::switchpoint);
+	if ((memcmp(m_pHeader->magic, evohome::schedule::cache::magic, sizeof(m_pHeader->magic)) != 0) ||
+	    (m_pHeader->version != evohome::schedule::cache::version) || (m_iSize < expectedSize))
+	{
+		close();
+		return false;
+	}
+	m_pIndex = reinterpret_cast<const evohome::schedule::cache::zone_index*>(m_pData + sizeof(evohome::schedule::cache::header));
+	m_pSwitchpoints = reinterpret_cast<const evohome::schedule::cache::switchpoint*>(m_pIndex + m_pHeader->numZones);
+	return true;
+}
+
+
+void ScheduleCache::close()
+{
+#ifndef _WIN32
+	if (m_bMapped)
+		munmap(const_cast<char*>(m_pData), m_iSize);
+#endif
+	std::vector<char>().swap(m_vBuffer);
+	m_pData = NULL;
+	m_iSize = 0;
+	m_bMapped = false;
+	m_pHeader = NULL;
+	m_pIndex = NULL;
+	m_pSwitchpoints = NULL;
+}
+
+
+bool ScheduleCache::is_open()
+{
+	return (m_pHeader != NULL);
+}
+
+
+time_t ScheduleCache::get_creation_time()
+{
+	if (m_pHeader == NULL)
+		return 0;
+	return static_cast<time_t>(m_pHeader->tCreated);
+}
+
+
+/* private */ const evohome::schedule::cache::zone_index *ScheduleCache::find_zone(const std::string &szZoneId)
+{
+	if ((m_pHeader == NULL) || (szZoneId.length() >= sizeof(evohome::schedule::cache::zone_index::szZoneId)))
+		return NULL;
+
+	size_t lo = 0;
+	size_t hi = m_pHeader->numZones;
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		int cmp = strncmp(m_pIndex[mid].szZoneId, szZoneId.c_str(), sizeof(evohome::schedule::cache::zone_index::szZoneId));
+		if (cmp == 0)
+		{
+			const evohome::schedule::cache::zone_index *zoneIndex = &m_pIndex[mid];
+			if (static_cast<size_t>(zoneIndex->firstSwitchpoint) + zoneIndex->dayStart[7] > m_pHeader->numSwitchpoints)
+				return NULL;
+			return zoneIndex;
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
+}
+
+
+/* private */ std::string ScheduleCache::get_value_string(const evohome::schedule::cache::zone_index *zoneIndex, const int32_t value)
+{
+	if (zoneIndex->bDHW)
+		return (value) ? "On" : "Off";
+	return Json::valueToString(static_cast<double>(value) / 100);
+}
+
+
+bool ScheduleCache::get_next_switchpoint(const std::string &szZoneId, const time_t tNow, time_t &tNext, std::string &szCurrentSetpoint)
+{
+	const evohome::schedule::cache::zone_index *zoneIndex = find_zone(szZoneId);
+	if ((zoneIndex == NULL) || (zoneIndex->dayStart[7] == 0))
+		return false;
+	const evohome::schedule::cache::switchpoint *pZone = m_pSwitchpoints + zoneIndex->firstSwitchpoint;
+
+	struct tm ltime;
+	localtime_r(&tNow, &ltime);
+	uint32_t secondOfDay = static_cast<uint32_t>(ltime.tm_hour * 3600 + ltime.tm_min * 60 + ltime.tm_sec);
+	int weekday = ltime.tm_wday;
+
+	// current setpoint: last switchpoint at or before now, going back through the week
+	bool bCurrentFound = false;
+	for (int subtractDays = 0; (subtractDays < 7) && !bCurrentFound; subtractDays++)
+	{
+		int day = (weekday - subtractDays + 7) % 7;
+		for (int i = zoneIndex->dayStart[day + 1] - 1; i >= static_cast<int>(zoneIndex->dayStart[day]); i--)
+		{
+			if ((subtractDays == 0) && (pZone[i].secondOfDay > secondOfDay))
+				continue;
+			szCurrentSetpoint = get_value_string(zoneIndex, pZone[i].value);
+			bCurrentFound = true;
+			break;
+		}
+	}
+
+	// next switchpoint: first switchpoint after now, up to the same weekday next week
+	for (int addDays = 0; addDays <= 7; addDays++)
+	{
+		int day = (weekday + addDays) % 7;
+		for (int i = zoneIndex->dayStart[day]; i < static_cast<int>(zoneIndex->dayStart[day + 1]); i++)
+		{
+			if ((addDays == 0) && (pZone[i].secondOfDay <= secondOfDay))
+				continue;
+			struct tm ntime = ltime;
+			ntime.tm_isdst = -1;
+			ntime.tm_mday += addDays;
+			ntime.tm_hour = static_cast<int>(pZone[i].secondOfDay / 3600);
+			ntime.tm_min = static_cast<int>((pZone[i].secondOfDay / 60) % 60);
+			ntime.tm_sec = static_cast<int>(pZone[i].secondOfDay % 60);
+			tNext = mktime(&ntime);
+			return bCurrentFound;
+		}
+	}
+	return false;
+}
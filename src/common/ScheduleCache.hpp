@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Binary schedule cache for Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include "schedules.hpp"
+
+
+class ScheduleCache
+{
+public:
+	ScheduleCache();
+	~ScheduleCache();
+	ScheduleCache(const ScheduleCache&) = delete;
+	ScheduleCache& operator=(const ScheduleCache&) = delete;
+
+/*
+ * Write precompiled switchpoint tables to a binary cache file
+ *
+ * The file is replaced atomically. It uses the native byte order and is not meant
+ * for exchange between machines - use the JSON backup format for that.
+ */
+	static bool write(const std::string &szFilename, const std::vector<evohome::schedule::cache::zone> &vZones);
+
+
+/*
+ * Map a binary cache file into memory
+ *
+ * The tables are used in place without parsing. Returns false if the file does not
+ * exist or has an unknown format.
+ */
+	bool open(const std::string &szFilename);
+	void close();
+	bool is_open();
+	time_t get_creation_time();
+
+
+/*
+ * Find the switchpoint that follows tNow (localtime) in a zone's schedule
+ *
+ * Sets tNext to the time of that switchpoint and szCurrentSetpoint to the setpoint
+ * or hot water state that is active at tNow. Returns false if the zone is not in
+ * the cache or has an empty schedule.
+ */
+	bool get_next_switchpoint(const std::string &szZoneId, const time_t tNow, time_t &tNext, std::string &szCurrentSetpoint);
+
+
+private:
+	const evohome::schedule::cache::zone_index *find_zone(const std::string &szZoneId);
+	std::string get_value_string(const evohome::schedule::cache::zone_index *zoneIndex, const int32_t value);
+
+private:
+	const char *m_pData;
+	size_t m_iSize;
+	std::vector<char> m_vBuffer;	// used where the file cannot be mapped
+	bool m_bMapped;
+
+	const evohome::schedule::cache::header *m_pHeader;
+	const evohome::schedule::cache::zone_index *m_pIndex;
+	const evohome::schedule::cache::switchpoint *m_pSwitchpoints;
+};
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Compact writer for Evohome schedule PUT requests
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <vector>
+#include <algorithm>
+#include "ScheduleWriter.hpp"
+
+
+void ScheduleWriter::write(const Json::Value &jSchedule, std::string &szOutput)
+{
+	szOutput.clear();
+	write_value(jSchedule, szOutput);
+}
+
+
+/* private */ void ScheduleWriter::write_value(const Json::Value &jValue, std::string &szOutput)
+{
+	switch (jValue.type())
+	{
+		case Json::nullValue:
+			szOutput.append("null");
+			break;
+		case Json::intValue:
+			Json::appendNumber(jValue.asLargestInt(), szOutput);
+			break;
+		case Json::uintValue:
+			Json::appendNumber(jValue.asLargestUInt(), szOutput);
+			break;
+		case Json::realValue:
+			Json::appendNumber(jValue.asDouble(), szOutput);
+			break;
+		case Json::booleanValue:
+			szOutput.append(jValue.asBool() ? "true" : "false");
+			break;
+		case Json::stringValue:
+		{
+			const char *str;
+			const char *end;
+			if (jValue.getString(&str, &end))
+				write_string(str, end, false, szOutput);
+			else
+				szOutput.append("\"\"");
+			break;
+		}
+		case Json::arrayValue:
+		{
+			szOutput.append(1, '[');
+			Json::ArrayIndex n = jValue.size();
+			for (Json::ArrayIndex i = 0; i < n; i++)
+			{
+				if (i > 0)
+					szOutput.append(1, ',');
+				write_value(jValue[i], szOutput);
+			}
+			szOutput.append(1, ']');
+			break;
+		}
+		case Json::objectValue:
+		{
+			szOutput.append(1, '{');
+			Json::Value::const_iterator it;
+			for (it = jValue.begin(); it != jValue.end(); ++it)
+			{
+				if (it != jValue.begin())
+					szOutput.append(1, ',');
+				const char *end;
+				const char *str = it.memberName(&end);
+				write_string(str, end, true, szOutput);
+				szOutput.append(1, ':');
+				write_value(*it, szOutput);
+			}
+			szOutput.append(1, '}');
+			break;
+		}
+	}
+}
+
+
+/* private */ void ScheduleWriter::write_string(const char *str, const char *end, const bool bKey, std::string &szOutput)
+{
+	size_t len = static_cast<size_t>(end - str);
+	if (bKey && (len == 11) && ((str[0] | 0x20) == 't') && (memcmp(str + 1, "emperature", 10) == 0))
+	{
+		szOutput.append("\"TargetTemperature\"");
+		return;
+	}
+
+	bool bPlain = true;
+	for (const char *c = str; c < end; c++)
+	{
+		if ((*c == '"') || (*c == '\\') || (static_cast<unsigned char>(*c) < 0x20))
+		{
+			bPlain = false;
+			break;
+		}
+	}
+
+	if (!bPlain)
+	{
+		// rare: let jsoncpp take care of escaping
+		std::string szValue(str, len);
+		if ((szValue[0] > 0x60) && (szValue[0] < 0x7b))
+			szValue[0] ^= 0x20;
+		Json::appendQuotedString(szValue.c_str(), szValue.size(), szOutput);
+		return;
+	}
+
+	szOutput.append(1, '"');
+	if (len > 0)
+	{
+		char c = str[0];
+		if ((c > 0x60) && (c < 0x7b))
+			c ^= 0x20;
+		szOutput.append(1, c);
+		szOutput.append(str + 1, len - 1);
+	}
+	szOutput.append(1, '"');
+}
+
+
+void ScheduleWriter::write_canonical(const Json::Value &jSchedule, std::string &szOutput)
+{
+	szOutput.clear();
+	std::vector<std::vector<std::string> > vDays(7);
+
+	const Json::Value *jDailySchedules = find_member(jSchedule, "dailySchedules");
+	if ((jDailySchedules != NULL) && jDailySchedules->isArray())
+	{
+		Json::ArrayIndex numDays = jDailySchedules->size();
+		for (Json::ArrayIndex d = 0; d < numDays; d++)
+		{
+			const Json::Value &jDay = (*jDailySchedules)[d];
+			int day = get_day_index(jDay);
+			const Json::Value *jSwitchpoints = find_member(jDay, "switchpoints");
+			if ((day < 0) || (jSwitchpoints == NULL) || !jSwitchpoints->isArray())
+				continue;
+
+			Json::ArrayIndex numSwitchpoints = jSwitchpoints->size();
+			for (Json::ArrayIndex i = 0; i < numSwitchpoints; i++)
+			{
+				const Json::Value &jSwitchpoint = (*jSwitchpoints)[i];
+				std::string szSwitchpoint;
+				const Json::Value *jTime = find_member(jSwitchpoint, "timeOfDay");
+				if ((jTime != NULL) && jTime->isString())
+					szSwitchpoint = jTime->asString();
+				if (szSwitchpoint.length() == 5)
+					szSwitchpoint.append(":00");
+				szSwitchpoint.append(1, '=');
+
+				const Json::Value *jValue = find_member(jSwitchpoint, "heatSetpoint");
+				if (jValue == NULL)
+					jValue = find_member(jSwitchpoint, "targetTemperature");
+				if (jValue == NULL)
+					jValue = find_member(jSwitchpoint, "temperature");
+				if ((jValue != NULL) && (jValue->isNumeric() || jValue->isString()))
+				{
+					char szTemperature[16];
+					double temperature = jValue->isNumeric() ? jValue->asDouble() : atof(jValue->asCString());
+					snprintf(szTemperature, sizeof(szTemperature), "%.2f", temperature);
+					szSwitchpoint.append(szTemperature);
+				}
+				else if (((jValue = find_member(jSwitchpoint, "dhwState")) != NULL) && jValue->isString())
+				{
+					std::string szState = jValue->asString();
+					for (size_t c = 0; c < szState.length(); c++)
+						szState[c] = static_cast<char>(tolower(szState[c]));
+					szSwitchpoint.append(szState);
+				}
+				vDays[day].push_back(szSwitchpoint);
+			}
+		}
+	}
+
+	for (size_t day = 0; day < 7; day++)
+	{
+		std::sort(vDays[day].begin(), vDays[day].end());
+		for (size_t i = 0; i < vDays[day].size(); i++)
+		{
+			if (i > 0)
+				szOutput.append(1, ',');
+			szOutput.append(vDays[day][i]);
+		}
+		szOutput.append(1, ';');
+	}
+}
+
+
+/* private */ const Json::Value *ScheduleWriter::find_member(const Json::Value &jObject, const char *szName)
+{
+	if (!jObject.isObject())
+		return NULL;
+	size_t len = strlen(szName);
+	Json::Value::const_iterator it;
+	for (it = jObject.begin(); it != jObject.end(); ++it)
+	{
+		const char *end;
+		const char *str = it.memberName(&end);
+		if ((static_cast<size_t>(end - str) != len) || (tolower(str[0]) != tolower(szName[0])))
+			continue;
+		if (memcmp(str + 1, szName + 1, len - 1) == 0)
+			return &(*it);
+	}
+	return NULL;
+}
+
+
+/* private */ int ScheduleWriter::get_day_index(const Json::Value &jDay)
+{
+	static const char* weekdays[7] = {"monday", "tuesday", "wednesday", "thursday", "friday", "saturday", "sunday"};
+	const Json::Value *jDayOfWeek = find_member(jDay, "dayOfWeek");
+	if (jDayOfWeek == NULL)
+		return -1;
+	if (!jDayOfWeek->isString())
+		return (jDayOfWeek->isIntegral() && (jDayOfWeek->asInt() >= 0) && (jDayOfWeek->asInt() < 7)) ? jDayOfWeek->asInt() : -1;
+
+	std::string szDay = jDayOfWeek->asString();
+	for (size_t c = 0; c < szDay.length(); c++)
+		szDay[c] = static_cast<char>(tolower(szDay[c]));
+	for (int day = 0; day < 7; day++)
+	{
+		if (szDay == weekdays[day])
+			return day;
+	}
+	return -1;
+}
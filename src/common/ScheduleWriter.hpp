@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Compact writer for Evohome schedule PUT requests
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include "jsoncpp/json.h"
+
+
+class ScheduleWriter
+{
+public:
+
+/*
+ * Write a schedule as retrieved from the portal in the format that the portal expects for a PUT
+ *
+ * The output has no whitespace, every key and string value starts with a capital
+ * and the key 'temperature' becomes 'TargetTemperature'. szOutput is cleared first
+ * and may be reused between calls to avoid reallocation.
+ */
+	static void write(const Json::Value &jSchedule, std::string &szOutput);
+
+
+/*
+ * Write a canonical form of a schedule that can be compared as a plain string
+ *
+ * Only the daily switchpoints are used. Days are ordered Monday to Sunday, switchpoints
+ * are sorted by time, and key case, number formatting and a missing seconds field do
+ * not affect the result. Works on both the portal's GET format and the PUT format.
+ */
+	static void write_canonical(const Json::Value &jSchedule, std::string &szOutput);
+
+
+private:
+	static void write_value(const Json::Value &jValue, std::string &szOutput);
+	static void write_string(const char *str, const char *end, const bool bKey, std::string &szOutput);
+	static const Json::Value *find_member(const Json::Value &jObject, const char *szName);
+	static int get_day_index(const Json::Value &jDay);
+
+};
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Auth file access shared between processes
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include "SharedAuthFile.hpp"
+#include <cstdio>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+
+int SharedAuthFile::lock(const std::string &szFilename, const bool bExclusive)
+{
+#ifndef _WIN32
+	std::string szLockFile = szFilename + ".lock";
+	int fd = open(szLockFile.c_str(), O_RDWR | O_CREAT, 0600);
+	if (fd < 0)
+		return -1;
+	while (flock(fd, bExclusive ? LOCK_EX : LOCK_SH) != 0)
+	{
+		if (errno != EINTR)
+		{
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+
+void SharedAuthFile::unlock(const int lockHandle)
+{
+#ifndef _WIN32
+	if (lockHandle < 0)
+		return;
+	flock(lockHandle, LOCK_UN);
+	close(lockHandle);
+#endif
+}
+
+
+bool SharedAuthFile::read(const std::string &szFilename, std::string &szContent)
+{
+	std::ifstream myfile (szFilename.c_str());
+	if (!myfile.is_open())
+		return false;
+	std::stringstream ss;
+	ss << myfile.rdbuf();
+	szContent = ss.str();
+	myfile.close();
+	return true;
+}
+
+
+bool SharedAuthFile::write(const std::string &szFilename, const std::string &szContent)
+{
+#ifndef _WIN32
+	std::stringstream ss;
+	ss << szFilename << ".tmp." << getpid();
+	std::string szTempFile = ss.str();
+#else
+	std::string szTempFile = szFilename;
+#endif
+	std::ofstream myfile (szTempFile.c_str(), std::ofstream::trunc);
+	if (!myfile.is_open())
+		return false;
+	myfile << szContent;
+	myfile.close();
+#ifndef _WIN32
+	if (myfile.fail())
+	{
+		std::remove(szTempFile.c_str());
+		return false;
+	}
+	if (std::rename(szTempFile.c_str(), szFilename.c_str()) != 0)
+	{
+		std::remove(szTempFile.c_str());
+		return false;
+	}
+	return true;
+#else
+	return !myfile.fail();
+#endif
+}
+
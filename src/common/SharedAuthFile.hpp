@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Auth file access shared between processes
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+
+
+class SharedAuthFile
+{
+public:
+
+/*
+ * Lock the auth file for reading (shared) or for renewing the token it holds (exclusive)
+ *
+ * The lock is taken on a separate '.lock' file so that the auth file itself can be
+ * replaced while locked. Returns a handle to pass to unlock() or -1 if locking is
+ * not available, in which case the caller continues unlocked.
+ */
+	static int lock(const std::string &szFilename, const bool bExclusive);
+	static void unlock(const int lockHandle);
+
+
+/*
+ * Read the full file content
+ */
+	static bool read(const std::string &szFilename, std::string &szContent);
+
+
+/*
+ * Replace the file content atomically, readers see either the old or the new content
+ */
+	static bool write(const std::string &szFilename, const std::string &szContent);
+
+};
+
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Type definitions for batched commands in Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+
+namespace evohome {
+  namespace command {
+
+    namespace type {
+	enum value
+	{
+		zoneSetpoint,
+		dhwMode,
+		systemMode
+	};
+    }; // namespace type
+
+    typedef struct _sResult
+    {
+      evohome::command::type::value eType;
+      std::string szTargetId;	// zoneId, dhwId or systemId
+      bool bSuccess;
+      bool bSuperseded;	// replaced by a newer command for the same target before it was sent
+      std::string szError;
+    } result;
+
+    typedef std::function<void(const evohome::command::result&)> completion;
+
+    typedef struct _sQueued
+    {
+      evohome::command::type::value eType;
+      std::string szTargetId;
+      std::string szUrl;
+      std::string szPutData;
+      std::chrono::steady_clock::time_point tUpdated;
+      std::vector<evohome::command::completion> vCompletions;
+    } queued;
+
+    typedef struct _sSetpoint
+    {
+      std::string szZoneId;
+      std::string szSetpoint;	// empty to cancel the override
+      std::string szTimeUntil;	// empty for a permanent override
+      bool bSuccess;
+      std::string szError;
+    } setpoint;
+
+  }; // namespace command
+
+}; // namespace evohome
+
@@ -10,12 +10,54 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <ctime>
+#include <cstdint>
+#include <utility>
+#include <memory>
 #include "jsoncpp/json.h"
 
 
 namespace evohome {
   namespace device {
 
+    namespace status
+    {
+      typedef struct _sFault
+      {
+        std::string szFaultType;
+        time_t tSince;
+      } fault;
+
+      typedef struct _sZone // also used for Domestic Hot Water
+      {
+        bool bValid;			// set once the status has been decoded
+        bool bTemperatureAvailable;
+        double dTemperature;
+        double dSetpoint;		// zones only
+        int8_t mode;			// index in evohome::API2::zone::mode, -1 if unknown
+        int8_t state;			// hot water only: index in evohome::API2::dhw::state, -1 if unknown
+        time_t tUntil;			// 0 if the mode does not end
+        std::vector<evohome::device::status::fault> vFaults;
+      } zone;
+
+      typedef struct _sSystem
+      {
+        bool bValid;
+        int8_t mode;			// index in evohome::API2::system::mode, -1 if unknown
+        bool bPermanent;
+        time_t tUntil;			// 0 if the mode does not end
+        std::vector<evohome::device::status::fault> vFaults;
+      } system;
+
+      typedef struct _sLocation
+      {
+        std::vector<std::string> vGatewayIds;
+        std::vector<std::pair<std::string, evohome::device::status::system> > vSystems;	// systemId, status
+        std::vector<std::pair<std::string, evohome::device::status::zone> > vZones;	// zoneId or dhwId, status
+      } location;
+
+    }; // namespace status
+
     typedef struct _sZone // also used for Domestic Hot Water
     {
       uint8_t zoneIdx;
@@ -26,6 +68,10 @@ namespace evohome {
       Json::Value *jInstallationInfo;
       Json::Value *jStatus;
       Json::Value jSchedule;
+      time_t tScheduleFetched;	// time jSchedule was retrieved or last confirmed by the portal
+      evohome::device::status::zone status;	// used instead of jStatus in typed status mode
+      mutable const Json::Value *jStatusFields[4];	// resolved status members, see EvohomeClient2::get_status_field()
+      mutable unsigned int statusFieldsGeneration;
     } zone;
 
     typedef struct _sTemperatureControlSystem
@@ -36,6 +82,9 @@ namespace evohome {
       std::string szSystemId;
       Json::Value *jInstallationInfo;
       Json::Value *jStatus;
+      evohome::device::status::system status;	// used instead of jStatus in typed status mode
+      mutable const Json::Value *jStatusFields[2];
+      mutable unsigned int statusFieldsGeneration;
       std::vector<evohome::device::zone> zones;
       std::vector<evohome::device::zone> dhw;
     } temperatureControlSystem;
@@ -55,6 +104,7 @@ namespace evohome {
       uint8_t locationIdx;
       std::string szLocationId;
       Json::Value *jInstallationInfo;
+      std::shared_ptr<Json::Arena> statusArena;	// must be declared before jStatus: owns its memory if set
       Json::Value jStatus;
       std::vector<evohome::device::gateway> gateways;
     } location;
@@ -73,6 +123,39 @@ namespace evohome {
 
     }; // namespace path
 
+
+    namespace diff
+    {
+      namespace type {
+	enum value
+	{
+		added,
+		removed,
+		moved			// unchanged device whose struct was relocated: pointers to it must be renewed
+	};
+      }; // namespace type
+
+      namespace kind {
+	enum value
+	{
+		location,
+		gateway,
+		temperatureControlSystem,
+		zone,
+		dhw
+	};
+      }; // namespace kind
+
+      typedef struct _sChange
+      {
+        evohome::device::diff::type::value eType;
+        evohome::device::diff::kind::value eKind;
+        std::string szObjectId;
+        std::string szParentId;	// empty for locations
+      } change;
+
+    }; // namespace diff
+
   }; // namespace device
 
 }; // namespace evohome
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Type definitions for status change events in Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+
+namespace evohome {
+  namespace event {
+
+    namespace type {
+	enum value
+	{
+		zoneTemperature,
+		zoneSetpoint,
+		zoneMode,
+		zoneModeUntil,
+		dhwTemperature,
+		dhwState,
+		dhwMode,
+		dhwModeUntil,
+		systemMode,
+		systemModeUntil
+	};
+    }; // namespace type
+
+    typedef struct _sChange
+    {
+      evohome::event::type::value eType;
+      uint8_t locationIdx;
+      std::string szObjectId;	// zoneId, dhwId or systemId
+      std::string szOldValue;
+      std::string szNewValue;
+    } change;
+
+    typedef std::function<void(const evohome::event::change&)> callback;
+
+  }; // namespace event
+
+}; // namespace evohome
+
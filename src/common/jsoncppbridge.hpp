@@ -12,6 +12,7 @@
 #define _EvohomeJsonBridge
 
 #include <string>
+#include <memory>
 #include "jsoncpp/json.h"
 
 
@@ -31,13 +32,47 @@ static int parse_json_string(std::string &szInput, Json::Value &jOutput)
 		res = 1;
 	}
 
-	Json::CharReaderBuilder jBuilder;
-	std::unique_ptr<Json::CharReader> jReader(jBuilder.newCharReader());
+	// the reader holds no state between parses: keep one per thread
+	static thread_local std::unique_ptr<Json::CharReader> jReader;
+	if (!jReader)
+	{
+		Json::CharReaderBuilder jBuilder;
+		jReader.reset(jBuilder.newCharReader());
+	}
 	if (!jReader->parse(szInput.c_str(), szInput.c_str() + szInput.size(), &jOutput, nullptr))
 		return -1;
 	return res;
 }
 
+
+namespace json {
+
+/*
+ * Member name with its length fixed at compile time
+ *
+ * Lookups with a static key do not measure or copy the name, and unlike
+ * operator[] they never insert a missing member.
+ */
+class static_key : public Json::StaticString
+{
+public:
+	template <size_t N> explicit static_key(const char (&szName)[N]) : Json::StaticString(szName), m_szEnd(szName + N - 1) {}
+	const char *end() const { return m_szEnd; }
+
+private:
+	const char *m_szEnd;
+};
+
+
+static inline const Json::Value *find(const Json::Value *jValue, const static_key &key)
+{
+	if ((jValue == NULL) || !(*jValue).isObject())
+		return NULL;
+	return (*jValue).find(key.c_str(), key.end());
+}
+
+}; // namespace json
+
 }; // namespace evohome
 
 #endif
@@ -19,6 +19,9 @@ namespace evohome {
     static const std::string invalidAuthfile = "Failed to parse auth file content as JSON";
     static const std::string invalidResponse = "Failed to parse server response as JSON";
     static const std::string unhandledResponse = "Server returned an unhandled response";
+    static const std::string zoneNotFound = "Zone not found in installation";
+    static const std::string installationChanged = "Installation has changed, a full reload is required";
+    static const std::string scheduleUnavailable = "Failed to retrieve current schedule";
 
   }; // namespace messages
 
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Type definitions for schedule handling in Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdint>
+#include <memory>
+#include "jsoncpp/json.h"
+
+
+namespace evohome {
+  namespace schedule {
+
+    typedef struct _sRestoreItem
+    {
+      std::string szZoneId;	// zoneId or dhwId
+      std::string szName;
+      bool bDHW;
+      bool bChanged;	// backup differs from the schedule on the controller
+      bool bRestored;	// backup was sent and accepted
+      std::string szError;
+    } restore_item;
+
+    typedef struct _sRefresh
+    {
+      std::string szZoneId;
+      std::string szUrl;
+      std::vector<std::string> vRequestHeader;
+      time_t tRequested;
+      bool bNotModified;
+      bool bSuccess;
+      Json::Value jSchedule;
+      std::string szETag;
+      std::string szLastModified;
+    } refresh;
+
+    typedef struct _sFetch
+    {
+      std::string szUrl;
+      std::vector<std::string> vRequestHeader;
+      bool bhttpOK;
+      std::string szResponse;
+      std::vector<std::string> vHeaderData;
+      std::shared_ptr<const Json::Value> pSchedule;	// parsed response, shared with identical requests
+    } fetch;
+
+
+    namespace cache {
+
+	// binary schedule cache layout: header, zone index sorted by ID, switchpoint table
+
+	static const char magic[4] = {'E', 'V', 'S', 'C'};
+	static const uint32_t version = 1;
+
+	typedef struct _sHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t numZones;
+		uint32_t numSwitchpoints;
+		int64_t tCreated;
+	} header;
+
+	typedef struct _sZoneIndex
+	{
+		char szZoneId[32];
+		uint32_t firstSwitchpoint;
+		uint16_t dayStart[8];	// per weekday (Sunday = 0) relative to firstSwitchpoint, dayStart[7] is the total
+		uint8_t bDHW;
+		uint8_t reserved[3];
+	} zone_index;
+
+	typedef struct _sSwitchpoint
+	{
+		uint32_t secondOfDay;
+		int32_t value;		// setpoint in hundredths of a degree, or dhw state 0/1
+	} switchpoint;
+
+	typedef struct _sZone
+	{
+		std::string szZoneId;
+		bool bDHW;
+		std::vector<evohome::schedule::cache::switchpoint> vDays[7];
+	} zone;
+
+    }; // namespace cache
+
+  }; // namespace schedule
+
+}; // namespace evohome
+
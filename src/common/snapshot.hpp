@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Type definitions for immutable status snapshots in Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <ctime>
+#include "jsoncpp/json.h"
+
+
+namespace evohome {
+  namespace status {
+
+    /*
+     * A snapshot is never modified after it has been published. The index maps
+     * point into the status trees that are owned by the same snapshot.
+     */
+    typedef struct _sSnapshot
+    {
+      unsigned long serial;
+      time_t tRetrieved;
+      std::vector<std::shared_ptr<const Json::Value> > locations;	// status tree by locationIdx, may be empty
+      std::map<std::string, const Json::Value*> systems;		// systemId => status
+      std::map<std::string, const Json::Value*> zones;			// zoneId or dhwId => status
+    } snapshot;
+
+  }; // namespace status
+
+}; // namespace evohome
+
@@ -8,8 +8,11 @@
  */
 
 #include "EvoHTTPBridge.hpp"
+#include "../common/jsoncppbridge.hpp"
 #include <sstream>
 #include <iomanip>
+#include <cstdlib>
+#include <thread>
 
 namespace evohome {
   namespace API {
@@ -25,16 +28,124 @@ namespace evohome {
 }; // namespace evohome
 
 
+std::mutex EvoHTTPBridge::m_mtxInFlight;
+std::condition_variable EvoHTTPBridge::m_cvInFlight;
+std::map<std::string, std::shared_ptr<evohome::API::request::inflight> > EvoHTTPBridge::m_mInFlight;
+
+std::mutex EvoHTTPBridge::m_mtxRateLimit;
+double EvoHTTPBridge::m_dRateLimit = 0;
+double EvoHTTPBridge::m_dRateBurst = 0;
+double EvoHTTPBridge::m_dRateTokens = 0;
+std::chrono::steady_clock::time_point EvoHTTPBridge::m_tRateUpdate;
+
+
+/*
+ * Concurrent GET requests with identical method, URL and headers (which carry the
+ * session's auth identity) are coalesced: the first caller performs the transfer
+ * and every caller that arrives while it is in flight receives the same response.
+ * Callers that ask for the parsed response also share a single parse of the body.
+ */
 bool EvoHTTPBridge::SafeGET(const std::string &szUrl, const std::vector<std::string> &vExtraHeaders, std::string &szResponse, const long iTimeOut)
 {
 	std::vector<std::string> vHeaderData;
-	bool bhttpOK = Execute((connection::HTTP::method::value)evohome::API::method::GET, szUrl, "", vExtraHeaders, szResponse, vHeaderData, false, iTimeOut, true);
-	return ProcessResponse(szResponse, vHeaderData, bhttpOK);
+	return SafeGET(szUrl, vExtraHeaders, szResponse, vHeaderData, iTimeOut);
+}
+
+bool EvoHTTPBridge::SafeGET(const std::string &szUrl, const std::vector<std::string> &vExtraHeaders, std::string &szResponse, std::vector<std::string> &vHeaderData, const long iTimeOut)
+{
+	std::shared_ptr<evohome::API::request::inflight> pRequest = ExecuteGET(szUrl, vExtraHeaders, iTimeOut);
+	szResponse = pRequest->szResponse;
+	vHeaderData = pRequest->vHeaderData;
+	return pRequest->bhttpOK;
+}
+
+bool EvoHTTPBridge::SafeGET(const std::string &szUrl, const std::vector<std::string> &vExtraHeaders, std::string &szResponse, std::vector<std::string> &vHeaderData, std::shared_ptr<const Json::Value> &pParsed, const long iTimeOut)
+{
+	std::shared_ptr<evohome::API::request::inflight> pRequest = ExecuteGET(szUrl, vExtraHeaders, iTimeOut);
+	szResponse = pRequest->szResponse;
+	vHeaderData = pRequest->vHeaderData;
+	pParsed = GetParsed(*pRequest);
+	return pRequest->bhttpOK;
+}
+
+/*
+ * Move a parsed response into a tree owned by the caller
+ *
+ * The tree is taken over when no other caller holds it, otherwise it is copied.
+ * A response that did not parse leaves jOutput null.
+ */
+void EvoHTTPBridge::TakeParsed(std::shared_ptr<const Json::Value> &pParsed, Json::Value &jOutput)
+{
+	if (!pParsed)
+	{
+		jOutput = Json::Value();
+		return;
+	}
+	// the in-flight entry holds a reference while it can still hand out the tree
+	if (pParsed.use_count() == 1)
+		const_cast<Json::Value&>(*pParsed).swap(jOutput);
+	else
+		jOutput = *pParsed;
+	pParsed.reset();
+}
+
+/* private */ std::shared_ptr<evohome::API::request::inflight> EvoHTTPBridge::ExecuteGET(const std::string &szUrl, const std::vector<std::string> &vExtraHeaders, const long iTimeOut)
+{
+	std::string szKey = GetRequestKey("GET", szUrl, vExtraHeaders);
+	std::shared_ptr<evohome::API::request::inflight> pRequest;
+	{
+		std::unique_lock<std::mutex> lock(m_mtxInFlight);
+		std::map<std::string, std::shared_ptr<evohome::API::request::inflight> >::iterator it = m_mInFlight.find(szKey);
+		if (it != m_mInFlight.end())
+		{
+			// identical request is already in flight - wait for its result
+			pRequest = it->second;
+			m_cvInFlight.wait(lock, [&pRequest]{ return pRequest->bDone; });
+			return pRequest;
+		}
+		pRequest = std::make_shared<evohome::API::request::inflight>();
+		pRequest->bDone = false;
+		pRequest->bhttpOK = false;
+		pRequest->bParsed = false;
+		m_mInFlight[szKey] = pRequest;
+	}
+
+	// other callers only read the result after bDone is set
+	WaitForRateLimit();
+	bool bhttpOK = Execute((connection::HTTP::method::value)evohome::API::method::GET, szUrl, "", vExtraHeaders, pRequest->szResponse, pRequest->vHeaderData, false, iTimeOut, true);
+	bhttpOK = ProcessResponse(pRequest->szResponse, pRequest->vHeaderData, bhttpOK);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mtxInFlight);
+		pRequest->bhttpOK = bhttpOK;
+		pRequest->bDone = true;
+		m_mInFlight.erase(szKey);
+	}
+	m_cvInFlight.notify_all();
+	return pRequest;
+}
+
+/* private */ std::shared_ptr<const Json::Value> EvoHTTPBridge::GetParsed(evohome::API::request::inflight &request)
+{
+	std::lock_guard<std::mutex> lock(request.mtxParse);
+	if (request.bParsed)
+		return request.pParsed;
+	request.bParsed = true;
+	if (!request.bhttpOK || request.szResponse.empty())
+		return request.pParsed;
+
+	// parse_json_string() alters responses that are an unnamed array
+	std::string szBody = request.szResponse;
+	std::shared_ptr<Json::Value> pValue = std::make_shared<Json::Value>();
+	if (evohome::parse_json_string(szBody, *pValue) >= 0)
+		request.pParsed = pValue;
+	return request.pParsed;
 }
 
 bool EvoHTTPBridge::SafePOST(const std::string &szUrl, const std::string &szPostdata, const std::vector<std::string> &vExtraHeaders, std::string &szResponse, const long iTimeOut)
 {
 	std::vector<std::string> vHeaderData;
+	WaitForRateLimit();
 	bool bhttpOK = Execute((connection::HTTP::method::value)evohome::API::method::POST, szUrl, szPostdata, vExtraHeaders, szResponse, vHeaderData, false, iTimeOut, true);
 	return ProcessResponse(szResponse, vHeaderData, bhttpOK);
 }
@@ -42,6 +153,7 @@ bool EvoHTTPBridge::SafePOST(const std::string &szUrl, const std::string &szPost
 bool EvoHTTPBridge::SafePUT(const std::string &szUrl, const std::string &szPutdata, const std::vector<std::string> &vExtraHeaders, std::string &szResponse, const long iTimeOut)
 {
 	std::vector<std::string> vHeaderData;
+	WaitForRateLimit();
 	bool bhttpOK = Execute((connection::HTTP::method::value)evohome::API::method::PUT, szUrl, szPutdata, vExtraHeaders, szResponse, vHeaderData, false, iTimeOut, true);
 	return ProcessResponse(szResponse, vHeaderData, bhttpOK);
 }
@@ -49,10 +161,63 @@ bool EvoHTTPBridge::SafePUT(const std::string &szUrl, const std::string &szPutda
 bool EvoHTTPBridge::SafeDELETE(const std::string &szUrl, const std::string &szPutdata, const std::vector<std::string> &vExtraHeaders, std::string &szResponse, const long iTimeOut)
 {
 	std::vector<std::string> vHeaderData;
+	WaitForRateLimit();
 	bool bhttpOK = Execute((connection::HTTP::method::value)evohome::API::method::DELETE, szUrl, szPutdata, vExtraHeaders, szResponse, vHeaderData, false, iTimeOut, true);
 	return ProcessResponse(szResponse, vHeaderData, bhttpOK);
 }
 
+/*
+ * Limit the rate of requests sent by all clients in this process
+ *
+ * Token bucket: allows bursts of up to iBurst requests, refilled at
+ * dRequestsPerSecond. A rate of zero (default) disables the limit.
+ */
+void EvoHTTPBridge::SetRateLimit(const double dRequestsPerSecond, const int iBurst)
+{
+	std::lock_guard<std::mutex> lock(m_mtxRateLimit);
+	m_dRateLimit = (dRequestsPerSecond > 0) ? dRequestsPerSecond : 0;
+	m_dRateBurst = (iBurst > 0) ? iBurst : 1;
+	m_dRateTokens = m_dRateBurst;
+	m_tRateUpdate = std::chrono::steady_clock::now();
+}
+
+/* private */ void EvoHTTPBridge::WaitForRateLimit()
+{
+	double dWait;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxRateLimit);
+		if (m_dRateLimit <= 0)
+			return;
+		std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+		double dElapsed = std::chrono::duration<double>(tNow - m_tRateUpdate).count();
+		m_tRateUpdate = tNow;
+		m_dRateTokens += dElapsed * m_dRateLimit;
+		if (m_dRateTokens > m_dRateBurst)
+			m_dRateTokens = m_dRateBurst;
+
+		// reserve a token, going into debt if the bucket is empty
+		m_dRateTokens -= 1;
+		if (m_dRateTokens >= 0)
+			return;
+		dWait = -m_dRateTokens / m_dRateLimit;
+	}
+	std::this_thread::sleep_for(std::chrono::duration<double>(dWait));
+}
+
+/* private */ std::string EvoHTTPBridge::GetRequestKey(const std::string &szMethod, const std::string &szUrl, const std::vector<std::string> &vExtraHeaders)
+{
+	std::string szKey = szMethod;
+	szKey.append(" ");
+	szKey.append(szUrl);
+	std::vector<std::string>::const_iterator itt;
+	for (itt = vExtraHeaders.begin(); itt != vExtraHeaders.end(); ++itt)
+	{
+		szKey.append("\n");
+		szKey.append(*itt);
+	}
+	return szKey;
+}
+
 std::string EvoHTTPBridge::URLEncode(const std::string szDecodedString)
 {
 	char c;
@@ -227,6 +392,44 @@ bool EvoHTTPBridge::ProcessResponse(std::string &szResponse, const std::vector<s
 	return false;
 }
 
+/*
+ * Return the numeric HTTP status code from the response headers, or -1 if not available
+ */
+int EvoHTTPBridge::GetHTTPStatus(const std::vector<std::string> &vHeaderData)
+{
+	if (vHeaderData.empty() || (vHeaderData[0].compare(0, 5, "HTTP/") != 0))
+		return -1;
+	size_t pos = vHeaderData[0].find(" ");
+	if (pos == std::string::npos)
+		return -1;
+	return atoi(vHeaderData[0].substr(pos + 1, 3).c_str());
+}
+
+
+/*
+ * Return the value of a response header, header names are matched case insensitive
+ */
+std::string EvoHTTPBridge::GetHeaderValue(const std::vector<std::string> &vHeaderData, const std::string &szName)
+{
+	size_t namelen = szName.length();
+	std::vector<std::string>::const_iterator itt;
+	for (itt = vHeaderData.begin(); itt != vHeaderData.end(); ++itt)
+	{
+		if (((*itt).length() <= namelen) || ((*itt)[namelen] != ':'))
+			continue;
+		size_t i = 0;
+		while ((i < namelen) && (((*itt)[i] | 0x20) == (szName[i] | 0x20)))
+			i++;
+		if (i < namelen)
+			continue;
+		i++;
+		while ((i < (*itt).length()) && ((*itt)[i] == ' '))
+			i++;
+		return (*itt).substr(i);
+	}
+	return "";
+}
+
 void EvoHTTPBridge::CloseConnection()
 {
 	EvoHTTPBridge::Cleanup();
@@ -9,12 +9,47 @@
 
 #pragma once
 #include "RESTClient.hpp"
+#include "jsoncpp/json.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+
+namespace evohome {
+  namespace API {
+    namespace request {
+
+	typedef struct _sInFlight
+	{
+		bool bDone;
+		bool bhttpOK;
+		std::string szResponse;
+		std::vector<std::string> vHeaderData;
+		std::mutex mtxParse;
+		bool bParsed;
+		std::shared_ptr<const Json::Value> pParsed;	// response body parsed once, on first demand
+	} inflight;
+
+	typedef struct _sValidator
+	{
+		std::string szETag;
+		std::string szLastModified;
+	} validator;
+
+    }; // namespace request
+  }; // namespace API
+}; // namespace evohome
 
 
 class EvoHTTPBridge : public RESTClient
 {
 public:
 	static bool SafeGET(const std::string &szUrl, const std::vector<std::string> &ExtraHeaders, std::string &szResponse, const long iTimeOut = -1);
+	static bool SafeGET(const std::string &szUrl, const std::vector<std::string> &ExtraHeaders, std::string &szResponse, std::vector<std::string> &vHeaderData, const long iTimeOut = -1);
+	static bool SafeGET(const std::string &szUrl, const std::vector<std::string> &ExtraHeaders, std::string &szResponse, std::vector<std::string> &vHeaderData, std::shared_ptr<const Json::Value> &pParsed, const long iTimeOut = -1);
+	static void TakeParsed(std::shared_ptr<const Json::Value> &pParsed, Json::Value &jOutput);
 	static bool SafePOST(const std::string &szUrl, const std::string &szPostdata, const std::vector<std::string> &ExtraHeaders, std::string &szResponse, const long iTimeOut = -1);
 	static bool SafePUT(const std::string &szUrl, const std::string &szPutdata, const std::vector<std::string> &ExtraHeaders, std::string &szResponse, const long iTimeOut = -1);
 	static bool SafeDELETE(const std::string &szUrl, const std::string &szPutdata, const std::vector<std::string> &ExtraHeaders, std::string &szResponse, const long iTimeOut = -1);
@@ -22,7 +57,29 @@ public:
 	static std::string URLEncode(std::string szDecodedString);
 	static bool ProcessResponse(std::string &szResponse, const std::vector<std::string> &vHeaderData, const bool bhttpOK);
 
+	static int GetHTTPStatus(const std::vector<std::string> &vHeaderData);
+	static std::string GetHeaderValue(const std::vector<std::string> &vHeaderData, const std::string &szName);
+
 	static void CloseConnection();
+
+	static void SetRateLimit(const double dRequestsPerSecond, const int iBurst);
+
+private:
+	static std::shared_ptr<evohome::API::request::inflight> ExecuteGET(const std::string &szUrl, const std::vector<std::string> &vExtraHeaders, const long iTimeOut);
+	static std::shared_ptr<const Json::Value> GetParsed(evohome::API::request::inflight &request);
+	static std::string GetRequestKey(const std::string &szMethod, const std::string &szUrl, const std::vector<std::string> &vExtraHeaders);
+	static void WaitForRateLimit();
+
+private:
+	static std::mutex m_mtxInFlight;
+	static std::condition_variable m_cvInFlight;
+	static std::map<std::string, std::shared_ptr<evohome::API::request::inflight> > m_mInFlight;
+
+	static std::mutex m_mtxRateLimit;
+	static double m_dRateLimit;
+	static double m_dRateBurst;
+	static double m_dRateTokens;
+	static std::chrono::steady_clock::time_point m_tRateUpdate;
 };
 
 
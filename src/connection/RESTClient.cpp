@@ -11,6 +11,7 @@
 #include <curl/curl.h>
 #include <algorithm>
 #include <sstream>
+#include <mutex>
 
 
 /************************************************************************
@@ -26,6 +27,11 @@ long		RESTClient::m_iConnectionTimeout = 10;
 long		RESTClient::m_iTimeout = 90;
 std::string	RESTClient::m_sUserAgent = "curle/1.0";
 std::string	RESTClient::m_sCookieFile = "cookie.txt";
+bool		RESTClient::m_bSharedConnections = true;
+int		RESTClient::m_iActiveRequests = 0;
+void*		RESTClient::m_pShare = NULL;
+std::mutex	RESTClient::m_mtxGlobal;
+std::mutex	RESTClient::m_mtxShare[8];
 
 
 /************************************************************************
@@ -61,6 +67,13 @@ void RESTClient::SetCookieFile(const std::string &cookiefile)
 	m_sCookieFile = cookiefile;
 }
 
+
+void RESTClient::SetSharedConnections(const bool enable)
+{
+	std::lock_guard<std::mutex> lock(m_mtxGlobal);
+	m_bSharedConnections = enable;
+}
+
 /************************************************************************
  *									*
  * Curl callback writer functions					*
@@ -87,6 +100,18 @@ size_t write_curl_data(void *contents, size_t size, size_t nmemb, void *userp)
 	return realsize;
 }
 
+void lock_curl_share(CURL * /*handle*/, curl_lock_data data, curl_lock_access /*access*/, void *userp)
+{
+	std::mutex* pmtxShare = (std::mutex*)userp;
+	pmtxShare[data & 0x07].lock();
+}
+
+void unlock_curl_share(CURL * /*handle*/, curl_lock_data data, void *userp)
+{
+	std::mutex* pmtxShare = (std::mutex*)userp;
+	pmtxShare[data & 0x07].unlock();
+}
+
 }; // namespace callback
 }; // namespace HTTP
 }; // namespace connection
@@ -98,8 +123,16 @@ size_t write_curl_data(void *contents, size_t size, size_t nmemb, void *userp)
  *									*
  ************************************************************************/
 
+/*
+ * Initialize curl on first use and register an active request
+ *
+ * curl_global_init() is not thread safe. Every successful call must be paired
+ * with ReleaseGlobal() so that Cleanup() will not pull the global state from
+ * under a request that is still running in another thread.
+ */
 bool RESTClient::CheckIfGlobalInitDone()
 {
+	std::lock_guard<std::mutex> lock(m_mtxGlobal);
 	if (!m_bCurlGlobalInitialized)
 	{
 		CURLcode res = curl_global_init(CURL_GLOBAL_ALL);
@@ -107,11 +140,44 @@ bool RESTClient::CheckIfGlobalInitDone()
 			return false;
 		m_bCurlGlobalInitialized = true;
 	}
+	if (m_bSharedConnections && (m_pShare == NULL))
+		InitShare();
+	m_iActiveRequests++;
 	return true;
 }
 
+void RESTClient::ReleaseGlobal()
+{
+	std::lock_guard<std::mutex> lock(m_mtxGlobal);
+	m_iActiveRequests--;
+}
+
+void RESTClient::InitShare()
+{
+	CURLSH *share = curl_share_init();
+	if (!share)
+		return;
+	curl_share_setopt(share, CURLSHOPT_LOCKFUNC, connection::HTTP::callback::lock_curl_share);
+	curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, connection::HTTP::callback::unlock_curl_share);
+	curl_share_setopt(share, CURLSHOPT_USERDATA, (void *)m_mtxShare);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	m_pShare = share;
+}
+
 void RESTClient::Cleanup()
 {
+	std::lock_guard<std::mutex> lock(m_mtxGlobal);
+	if (m_iActiveRequests > 0)
+		return; // still in use by another thread
+	if (m_pShare != NULL)
+	{
+		curl_share_cleanup((CURLSH *)m_pShare);
+		m_pShare = NULL;
+	}
 	if (m_bCurlGlobalInitialized)
 	{
 		curl_global_cleanup();
@@ -134,6 +200,8 @@ void RESTClient::SetGlobalOptions(void *curlobj)
 	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
 	curl_easy_setopt(curl, CURLOPT_COOKIEFILE, m_sCookieFile.c_str());
 	curl_easy_setopt(curl, CURLOPT_COOKIEJAR, m_sCookieFile.c_str());
+	if (m_bSharedConnections && (m_pShare != NULL))
+		curl_easy_setopt(curl, CURLOPT_SHARE, (CURLSH *)m_pShare);
 }
 
 
@@ -147,11 +215,18 @@ void RESTClient::SetGlobalOptions(void *curlobj)
  ************************************************************************/
 
 bool RESTClient::ExecuteBinary(const connection::HTTP::method::value eMethod, const std::string &szUrl, const std::string &szPostdata, const std::vector<std::string> &vExtraHeaders, std::vector<unsigned char> &vResponse, std::vector<std::string> &vHeaderData, const bool bFollowRedirect, const long iTimeOut)
+{
+	if (!CheckIfGlobalInitDone())
+		return false;
+	bool bResult = ExecuteCurl(eMethod, szUrl, szPostdata, vExtraHeaders, vResponse, vHeaderData, bFollowRedirect, iTimeOut);
+	ReleaseGlobal();
+	return bResult;
+}
+
+/* private */ bool RESTClient::ExecuteCurl(const connection::HTTP::method::value eMethod, const std::string &szUrl, const std::string &szPostdata, const std::vector<std::string> &vExtraHeaders, std::vector<unsigned char> &vResponse, std::vector<std::string> &vHeaderData, const bool bFollowRedirect, const long iTimeOut)
 {
 	try
 	{
-		if (!CheckIfGlobalInitDone())
-			return false;
 		CURL *curl = curl_easy_init();
 		if (!curl)
 			return false;
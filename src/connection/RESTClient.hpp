@@ -10,6 +10,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <mutex>
 
 namespace connection {
   namespace HTTP {
@@ -63,12 +64,18 @@ public:
 	static void SetUserAgent(const std::string &useragent);
 	static void SetSecurityOptions(const bool verifypeer, const bool verifyhost);
 	static void SetCookieFile(const std::string &cookiefile);
+	static void SetSharedConnections(const bool enable);
 
 
 	/************************************************************************
 	 *									*
 	 * main method								*
 	 *									*
+	 * All requests share one DNS cache, TLS session cache and		*
+	 * connection pool, so that many clients in the same process	*
+	 * reuse connections to the same host. This can be disabled with	*
+	 * SetSharedConnections(false).						*
+	 *									*
 	 ************************************************************************/
 
 	static bool ExecuteBinary(const connection::HTTP::method::value eMethod, const std::string &szUrl, const std::string &szPostdata, const std::vector<std::string> &ExtraHeaders, std::vector<unsigned char> &vResponse, std::vector<std::string> &vHeaderData, const bool bFollowRedirect = true, const long iTimeOut = -1);
@@ -84,6 +91,9 @@ public:
 private:
 	static void SetGlobalOptions(void *curlobj);
 	static bool CheckIfGlobalInitDone();
+	static void ReleaseGlobal();
+	static bool ExecuteCurl(const connection::HTTP::method::value eMethod, const std::string &szUrl, const std::string &szPostdata, const std::vector<std::string> &ExtraHeaders, std::vector<unsigned char> &vResponse, std::vector<std::string> &vHeaderData, const bool bFollowRedirect, const long iTimeOut);
+	static void InitShare();
 
 private:
 	static bool m_bCurlGlobalInitialized;
@@ -93,6 +103,11 @@ private:
 	static long m_iTimeout;
 	static std::string m_sUserAgent;
 	static std::string m_sCookieFile;
+	static bool m_bSharedConnections;
+	static int m_iActiveRequests;
+	static void *m_pShare;
+	static std::mutex m_mtxGlobal;
+	static std::mutex m_mtxShare[8];
 };
 
 
@@ -154,7 +154,9 @@ bool EvohomeClient::save_auth_to_file(const std::string &szFilename)
 		jAuth["last_use"] = static_cast<int>(m_tLastWebCall);
 		jAuth["user_id"] = m_szUserId;
 
-		myfile << jAuth.toStyledString() << "\n";
+		std::string szAuth;
+		Json::BufferWriter("\t").write(jAuth, szAuth);
+		myfile << szAuth << "\n";
 		myfile.close();
 		return true;
 	}
@@ -252,7 +254,6 @@ bool EvohomeClient::is_session_valid()
 		return;
 
 	int l = static_cast<int>((*jLocation)["devices"].size());
-	int zoneIdx = 0;
 	for (int i = 0; i < l; i++)
 	{
 		if ((*jLocation)["devices"][i]["gatewayId"].asString() == m_vLocations[locationIdx].gateways[gatewayIdx].szGatewayId)
@@ -261,28 +262,29 @@ bool EvohomeClient::is_session_valid()
 			evohome::device::path::zone newzonepath = evohome::device::path::zone();
 			newDevice.jInstallationInfo = &(*jLocation)["devices"][i];
 			newDevice.szZoneId = (*jLocation)["devices"][i]["deviceID"].asString();
-			newDevice.zoneIdx = zoneIdx;
 			newDevice.systemIdx = 0;
 			newDevice.gatewayIdx = gatewayIdx;
 			newDevice.locationIdx = locationIdx;
 			if ((*jLocation)["devices"][i]["thermostatModelType"].asString() == evohome::API::device::type[0])
 			{
+				// zoneIdx must be the position in the zones vector
+				newDevice.zoneIdx = static_cast<uint8_t>((*myTCS).zones.size());
 				(*myTCS).zones.push_back(newDevice);
-				newzonepath.zoneIdx = zoneIdx;
 			}
 			else if ((*jLocation)["devices"][i]["thermostatModelType"].asString() == evohome::API::device::type[1])
 			{
+				newDevice.zoneIdx = 128;
 				(*myTCS).dhw.push_back(newDevice);
-				newzonepath.zoneIdx = 128;
 			}
+			else
+				continue; // not a zone or hot water device
 
+			newzonepath.zoneIdx = newDevice.zoneIdx;
 			newzonepath.locationIdx = locationIdx;
 			newzonepath.gatewayIdx = gatewayIdx;
 			newzonepath.systemIdx = 0;
 			newzonepath.szZoneId = newDevice.szZoneId;
 			m_vZonePaths.push_back(newzonepath);
-
-			zoneIdx++;
 		}
 	}
 }
@@ -390,6 +392,103 @@ bool EvohomeClient::full_installation()
 }
 
 
+/*
+ * Refresh the device data of the current installation
+ */
+bool EvohomeClient::get_status()
+{
+	if (m_vLocations.empty())
+		return full_installation();
+
+	std::string szUrl = evohome::API::uri::get_uri(evohome::API::uri::installationInfo, m_szUserId);
+	EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
+	m_tLastWebCall = time(NULL);
+
+	// evohome old API returns an unnamed json array which is not accepted by our parser
+	m_szResponse.insert(0, "{\"locations\": ");
+	m_szResponse.append("}");
+
+	Json::Value jStatus;
+	if (evohome::parse_json_string(m_szResponse, jStatus) < 0)
+	{
+		m_szLastError = evohome::messages::invalidResponse;
+		return false;
+	}
+
+	if ( (!jStatus["locations"].isArray()) || (!jStatus["locations"][0].isMember("locationID")))
+	{
+		m_szLastError = evohome::messages::unhandledResponse;
+		return false;
+	}
+
+	std::map<std::string, evohome::device::zone*> mDevices;
+	for (size_t il = 0; il < m_vLocations.size(); il++)
+	{
+		for (size_t igw = 0; igw < m_vLocations[il].gateways.size(); igw++)
+		{
+			evohome::device::temperatureControlSystem *myTCS = &m_vLocations[il].gateways[igw].temperatureControlSystems[0];
+			for (size_t iz = 0; iz < (*myTCS).zones.size(); iz++)
+				mDevices[(*myTCS).zones[iz].szZoneId] = &(*myTCS).zones[iz];
+			for (size_t iz = 0; iz < (*myTCS).dhw.size(); iz++)
+				mDevices[(*myTCS).dhw[iz].szZoneId] = &(*myTCS).dhw[iz];
+		}
+	}
+
+	bool bUnchanged = true;
+	size_t numUpdated = 0;
+	int l = static_cast<int>(jStatus["locations"].size());
+	for (int i = 0; i < l; i++)
+	{
+		Json::Value *jNewLocation = &jStatus["locations"][i];
+		int iloc = get_location_index((*jNewLocation)["locationID"].asString());
+		if (iloc < 0)
+		{
+			bUnchanged = false;
+			continue;
+		}
+
+		// location members other than the device list may be replaced as a whole
+		Json::Value *jLocation = m_vLocations[iloc].jInstallationInfo;
+		std::vector<std::string> vMembers = (*jNewLocation).getMemberNames();
+		for (size_t im = 0; im < vMembers.size(); im++)
+		{
+			if (vMembers[im] != "devices")
+				(*jLocation)[vMembers[im]].swap((*jNewLocation)[vMembers[im]]);
+		}
+
+		Json::Value *jNewDevices = &(*jNewLocation)["devices"];
+		if (!(*jNewDevices).isArray())
+			continue;
+		int numDevices = static_cast<int>((*jNewDevices).size());
+		for (int j = 0; j < numDevices; j++)
+		{
+			Json::Value *jNewDevice = &(*jNewDevices)[j];
+			std::string szModelType = (*jNewDevice)["thermostatModelType"].asString();
+			if ((szModelType != evohome::API::device::type[0]) && (szModelType != evohome::API::device::type[1]))
+				continue;
+
+			std::map<std::string, evohome::device::zone*>::iterator it = mDevices.find((*jNewDevice)["deviceID"].asString());
+			if ((it == mDevices.end()) || (it->second->locationIdx != iloc) ||
+			    ((*it->second->jInstallationInfo)["gatewayId"].asString() != (*jNewDevice)["gatewayId"].asString()) ||
+			    ((*it->second->jInstallationInfo)["thermostatModelType"].asString() != szModelType))
+			{
+				bUnchanged = false;
+				continue;
+			}
+			(*it->second->jInstallationInfo).swap(*jNewDevice);
+			numUpdated++;
+		}
+	}
+
+	if (!bUnchanged || (numUpdated != mDevices.size()))
+	{
+		m_szLastError = evohome::messages::installationChanged;
+		return false;
+	}
+	return true;
+}
+
+
 
 /************************************************************************
  *									*
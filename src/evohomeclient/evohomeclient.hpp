@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <string>
+#include <map>
 #include "jsoncpp/json.h"
 
 #include "../common/devices.hpp"
@@ -81,9 +82,17 @@ public:
  *	and references you may have towards a specific location or	*
  *	zone.								*
  *									*
+ *	get_status() fetches the same data but only refreshes the	*
+ *	existing structs: every device is matched on its ID and its	*
+ *	data is replaced in place, so pointers remain valid and the	*
+ *	gateways and devices are not scanned again. If a device was	*
+ *	added or removed it returns false and full_installation()	*
+ *	must be called. Devices that were matched are still updated.	*
+ *									*
  ************************************************************************/
 
 	bool full_installation();
+	bool get_status();
 
 
 /************************************************************************
@@ -43,6 +43,21 @@ namespace evohome {
       static const std::string state[2] = {"Off", "On"};
     }; // namespace dhw
 
+    namespace installation {
+      // members of installationInfo that are kept when the installation filter is enabled
+      static const std::string fields[] = {
+        "locations.locationInfo",
+        "locations.gateways.gatewayInfo",
+        "locations.gateways.temperatureControlSystems.systemId",
+        "locations.gateways.temperatureControlSystems.modelType",
+        "locations.gateways.temperatureControlSystems.zones.zoneId",
+        "locations.gateways.temperatureControlSystems.zones.name",
+        "locations.gateways.temperatureControlSystems.zones.modelType",
+        "locations.gateways.temperatureControlSystems.zones.zoneType",
+        "locations.gateways.temperatureControlSystems.dhw.dhwId"
+      };
+    }; // namespace installation
+
     namespace uri {
       static const std::string base = EVOHOME_HOST"/WebAPI/emea/api/v1/";
 
@@ -56,7 +71,7 @@ namespace evohome {
       static const std::string zoneUpcoming = "{type}/{id}/schedule/upcommingSwitchpoints?count=1";
 
 
-      static std::string get_uri(const std::string &szApiFunction, const std::string &szId = "", const uint8_t zoneType = 0)
+      static inline std::string get_uri(const std::string &szApiFunction, const std::string &szId = "", const uint8_t zoneType = 0)
       {
         std::string result = szApiFunction;
 
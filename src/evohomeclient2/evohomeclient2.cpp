@@ -12,12 +12,19 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <sys/stat.h>
+#include <thread>
 
 #include "API2.hpp"
 #include "evohomeclient2.hpp"
 #include "../connection/EvoHTTPBridge.hpp"
 #include "../common/jsoncppbridge.hpp"
 #include "../common/messages.hpp"
+#include "../common/SharedAuthFile.hpp"
+#include "../common/ScheduleWriter.hpp"
+#include "../common/JsonSaxReader.hpp"
+#include "statusdecoder.hpp"
 #include "../time/IsoTimeString.hpp"
 
 
@@ -30,6 +37,29 @@
 #define sprintf_s(buffer, buffer_size, stringbuffer, ...) (sprintf(buffer, stringbuffer, __VA_ARGS__))
 #endif
 
+#define SCHEDULE_REFRESH_RETRY_DELAY 60
+#define TOKEN_REFRESH_RETRY_DELAY 60
+
+
+/*
+ * Status members read by the getters, as object and member name
+ *
+ * Zones and hot water use four entries each, in the order temperature,
+ * setpoint or state, mode and until. Systems use the last two entries.
+ */
+static const evohome::json::static_key statusFieldKeys[10][2] = {
+	{evohome::json::static_key("temperatureStatus"), evohome::json::static_key("temperature")},
+	{evohome::json::static_key("setpointStatus"), evohome::json::static_key("targetHeatTemperature")},
+	{evohome::json::static_key("setpointStatus"), evohome::json::static_key("setpointMode")},
+	{evohome::json::static_key("setpointStatus"), evohome::json::static_key("until")},
+	{evohome::json::static_key("temperatureStatus"), evohome::json::static_key("temperature")},
+	{evohome::json::static_key("stateStatus"), evohome::json::static_key("state")},
+	{evohome::json::static_key("stateStatus"), evohome::json::static_key("mode")},
+	{evohome::json::static_key("stateStatus"), evohome::json::static_key("until")},
+	{evohome::json::static_key("systemModeStatus"), evohome::json::static_key("mode")},
+	{evohome::json::static_key("systemModeStatus"), evohome::json::static_key("timeUntil")}
+};
+
 
 /*
  * Class construct
@@ -42,6 +72,8 @@ EvohomeClient2::EvohomeClient2()
 
 EvohomeClient2::~EvohomeClient2()
 {
+	stop_command_queue();
+	stop_schedule_refresh();
 	cleanup();
 }
 
@@ -52,6 +84,22 @@ EvohomeClient2::~EvohomeClient2()
 /* private */ void EvohomeClient2::init()
 {
 	m_szEmptyFieldResponse = "";
+	m_tTokenExpirationTime = 0;
+	m_iTokenRefreshMargin = 0;
+	m_tTokenRefreshFailed = 0;
+	m_bIncrementalStatus = false;
+	m_bInstallationFilter = false;
+	m_bIncrementalInstallation = false;
+	m_vInstallationFields.assign(evohome::API2::installation::fields, evohome::API2::installation::fields + sizeof(evohome::API2::installation::fields) / sizeof(evohome::API2::installation::fields[0]));
+	m_bStatusSnapshots = false;
+	m_bTypedStatus = false;
+	m_bStatusArena = false;
+	m_iStatusGeneration = 1;
+	m_bCommandQueueStop = false;
+	m_bCommandInFlight = false;
+	m_iCommandQueueDelay = 0;
+	m_iScheduleTTL = 0;
+	m_bScheduleRefreshStop = false;
 }
 
 
@@ -82,6 +130,30 @@ void EvohomeClient2::set_empty_field_response(std::string szResponse)
 }
 
 
+void EvohomeClient2::set_incremental_status_update(const bool bEnable)
+{
+	m_bIncrementalStatus = bEnable;
+}
+
+
+void EvohomeClient2::set_incremental_installation_update(const bool bEnable)
+{
+	m_bIncrementalInstallation = bEnable;
+}
+
+
+void EvohomeClient2::set_status_snapshots(const bool bEnable)
+{
+	m_bStatusSnapshots = bEnable;
+}
+
+
+void EvohomeClient2::set_status_arena(const bool bEnable)
+{
+	m_bStatusArena = bEnable;
+}
+
+
 /************************************************************************
  *									*
  *	Evohome authentication						*
@@ -89,9 +161,16 @@ void EvohomeClient2::set_empty_field_response(std::string szResponse)
  ************************************************************************/
 
 
-/* private */ bool EvohomeClient2::obtain_access_token(const std::string &szCredentials)
+/*
+ * Request an access token
+ *
+ * The response is read into szResponse. A session renewal passes a local string so
+ * that other threads using the client are not affected; token and user ID are only
+ * published under m_mtxAuthHeader.
+ */
+/* private */ bool EvohomeClient2::obtain_access_token(const std::string &szCredentials, std::string &szResponse)
 {
-	m_szResponse = "";
+	szResponse = "";
 
 	std::vector<std::string> vLoginHeader;
 	vLoginHeader.push_back(evohome::API2::header::authkey);
@@ -102,10 +181,10 @@ void EvohomeClient2::set_empty_field_response(std::string szResponse)
 	szPostdata.append(szCredentials);
 
 	std::string szUrl = EVOHOME_HOST"/Auth/OAuth/Token";
-	EvoHTTPBridge::SafePOST(szUrl, szPostdata, vLoginHeader, m_szResponse, -1);
+	EvoHTTPBridge::SafePOST(szUrl, szPostdata, vLoginHeader, szResponse, -1);
 
 	Json::Value jLogin;
-	if (evohome::parse_json_string(m_szResponse, jLogin) < 0)
+	if (evohome::parse_json_string(szResponse, jLogin) < 0)
 	{
 		m_szLastError = evohome::messages::invalidResponse;
 		return false;
@@ -126,18 +205,16 @@ void EvohomeClient2::set_empty_field_response(std::string szResponse)
 		return false;
 	}
 
-	m_szAccessToken = jLogin["access_token"].asString();
-	m_szRefreshToken = jLogin["refresh_token"].asString();
-	m_tTokenExpirationTime = time(NULL) + atoi(jLogin["expires_in"].asString().c_str());
-	std::string szAuthBearer = "Authorization: bearer ";
-	szAuthBearer.append(m_szAccessToken);
-
-	m_vEvoHeader.clear();
-	m_vEvoHeader.push_back(szAuthBearer);
-	m_vEvoHeader.push_back(evohome::API2::header::accept);
-	m_vEvoHeader.push_back(evohome::API2::header::jsondata);
-
-	return request_user_id();
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+		m_szAccessToken = jLogin["access_token"].asString();
+		m_szRefreshToken = jLogin["refresh_token"].asString();
+		m_tTokenExpirationTime = time(NULL) + atoi(jLogin["expires_in"].asString().c_str());
+		set_auth_header();
+		if (!m_szUserId.empty()) // session renewal, user ID does not change
+			return true;
+	}
+	return request_user_id(szResponse);
 }
 
 
@@ -146,12 +223,14 @@ void EvohomeClient2::set_empty_field_response(std::string szResponse)
  */
 bool EvohomeClient2::login(const std::string &szUser, const std::string &szPassword)
 {
+	m_szUserId = "";
+
 	std::string szCredentials = "grant_type=password&Username=";
 	szCredentials.append(EvoHTTPBridge::URLEncode(szUser));
 	szCredentials.append("&Password=");
 	szCredentials.append(EvoHTTPBridge::URLEncode(szPassword));
 
-	return obtain_access_token(szCredentials);
+	return obtain_access_token(szCredentials, m_szResponse);
 }
 
 
@@ -160,35 +239,108 @@ bool EvohomeClient2::login(const std::string &szUser, const std::string &szPassw
  */
 bool EvohomeClient2::renew_login()
 {
-	if (m_szRefreshToken.empty())
-		return false;
+	std::lock_guard<std::mutex> refreshlock(m_mtxTokenRefresh);
+	return renew_session();
+}
+/* private */ bool EvohomeClient2::renew_session()
+{
+	if (m_szAuthFile.empty())
+		return refresh_access_token();
+
+	// elect this process to renew the token that is shared through the auth file
+	int lockHandle = SharedAuthFile::lock(m_szAuthFile, true);
+
+	time_t tExpiration;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+		tExpiration = m_tTokenExpirationTime;
+	}
+	Json::Value jAuth;
+	if (read_auth_file(m_szAuthFile, jAuth))
+	{
+		// another process may have renewed the token while we waited for the lock
+		time_t tFileExpiration = static_cast<time_t>(atoi(jAuth["expiration_time"].asString().c_str()));
+		if ((tFileExpiration > tExpiration) && (tFileExpiration > time(NULL) + m_iTokenRefreshMargin))
+		{
+			set_auth_from_json(jAuth);
+			SharedAuthFile::unlock(lockHandle);
+			return true;
+		}
+	}
 
+	bool bRenewed = refresh_access_token();
+	if (bRenewed)
+		write_auth_file(m_szAuthFile);
+	SharedAuthFile::unlock(lockHandle);
+	return bRenewed;
+}
+/* private */ bool EvohomeClient2::refresh_access_token()
+{
 	std::string szCredentials = "grant_type=refresh_token&refresh_token=";
-	szCredentials.append(m_szRefreshToken);
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+		if (m_szRefreshToken.empty())
+			return false;
+		szCredentials.append(m_szRefreshToken);
+	}
 
-	return obtain_access_token(szCredentials);
+	std::string szResponse;
+	return obtain_access_token(szCredentials, szResponse);
 }
 
 
 /*
  * Save authorization key to a backup file
+ *
+ * The file is replaced atomically and becomes the shared token store for this client:
+ * later session renewals are coordinated with other processes through this file.
  */
 bool EvohomeClient2::save_auth_to_file(const std::string &szFilename)
 {
-	std::ofstream myfile (szFilename.c_str(), std::ofstream::trunc);
-	if ( myfile.is_open() )
-	{
-		Json::Value jAuth;
+	int lockHandle = SharedAuthFile::lock(szFilename, true);
+	bool bSaved = write_auth_file(szFilename);
+	SharedAuthFile::unlock(lockHandle);
+	if (bSaved)
+		m_szAuthFile = szFilename;
+	return bSaved;
+}
+
 
+/* private */ bool EvohomeClient2::write_auth_file(const std::string &szFilename)
+{
+	Json::Value jAuth;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
 		jAuth["access_token"] = m_szAccessToken;
 		jAuth["refresh_token"] = m_szRefreshToken;
 		jAuth["expiration_time"] = static_cast<unsigned int>(m_tTokenExpirationTime);
-
-		myfile << jAuth.toStyledString() << "\n";
-		myfile.close();
-		return true;
+		jAuth["user_id"] = m_szUserId;
 	}
-	return false;
+	std::string szAuth;
+	Json::BufferWriter("\t").write(jAuth, szAuth);
+	szAuth.append(1, '\n');
+	return SharedAuthFile::write(szFilename, szAuth);
+}
+
+
+/* private */ bool EvohomeClient2::read_auth_file(const std::string &szFilename, Json::Value &jAuth)
+{
+	std::string szFileContent;
+	if (!SharedAuthFile::read(szFilename, szFileContent) || szFileContent.empty())
+		return false;
+	return (evohome::parse_json_string(szFileContent, jAuth) >= 0);
+}
+
+
+/* private */ void EvohomeClient2::set_auth_from_json(const Json::Value &jAuth)
+{
+	std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+	m_szAccessToken = jAuth["access_token"].asString();
+	m_szRefreshToken = jAuth["refresh_token"].asString();
+	m_tTokenExpirationTime = static_cast<time_t>(atoi(jAuth["expiration_time"].asString().c_str()));
+	if (!jAuth["user_id"].asString().empty())
+		m_szUserId = jAuth["user_id"].asString();
+	set_auth_header();
 }
 
 
@@ -198,42 +350,27 @@ bool EvohomeClient2::is_session_valid()
 }
 
 
+time_t EvohomeClient2::get_token_expiration_time()
+{
+	std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+	return m_tTokenExpirationTime;
+}
+
+
 /*
- * Load authorization key from a backup file
+ * Renew the session this many seconds before the access token expires, 0 disables
  */
-bool EvohomeClient2::load_auth_from_file(const std::string &szFilename)
+void EvohomeClient2::set_token_refresh_margin(const int seconds)
 {
-	std::string szFileContent;
-	std::ifstream myfile (szFilename.c_str());
-	if ( myfile.is_open() )
-	{
-		std::string line;
-		while ( getline (myfile,line) )
-		{
-			szFileContent.append(line);
-			szFileContent.append("\n");
-		}
-		myfile.close();
-	}
-	Json::Value jAuth;
-	if (evohome::parse_json_string(szFileContent, jAuth) < 0)
-	{
-		m_szLastError = evohome::messages::invalidAuthfile;
-		return false;
-	}
-
-	m_szAccessToken = jAuth["access_token"].asString();
-	m_szRefreshToken = jAuth["refresh_token"].asString();
-	m_tTokenExpirationTime = static_cast<time_t>(atoi(jAuth["expiration_time"].asString().c_str()));
+	m_iTokenRefreshMargin = (seconds > 0) ? seconds : 0;
+}
 
-	if (!is_session_valid())
-	{
-		bool bRenew = renew_login();
-		if (bRenew)
-			save_auth_to_file(szFilename);
-		return bRenew;
-	}
 
+/*
+ * Build the request header from the access token, must be called with m_mtxAuthHeader held
+ */
+/* private */ void EvohomeClient2::set_auth_header()
+{
 	std::string szAuthBearer = "Authorization: bearer ";
 	szAuthBearer.append(m_szAccessToken);
 
@@ -241,33 +378,127 @@ bool EvohomeClient2::load_auth_from_file(const std::string &szFilename)
 	m_vEvoHeader.push_back(szAuthBearer);
 	m_vEvoHeader.push_back(evohome::API2::header::accept);
 	m_vEvoHeader.push_back(evohome::API2::header::jsondata);
+}
+
+
+/*
+ * Renew the session if the access token is about to expire
+ *
+ * Only one thread renews. Other threads keep using the current token while it is
+ * still valid and only wait for the renewal in progress if it has already expired.
+ * After a failed renewal the next attempt is delayed for as long as the current
+ * token remains valid.
+ */
+/* private */ void EvohomeClient2::check_token_refresh()
+{
+	if (m_iTokenRefreshMargin == 0)
+		return;
+
+	time_t tExpiration;
+	time_t tLastFailure;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+		if (m_szRefreshToken.empty())
+			return;
+		tExpiration = m_tTokenExpirationTime;
+		tLastFailure = m_tTokenRefreshFailed;
+	}
+	time_t tNow = time(NULL);
+	if (tNow + m_iTokenRefreshMargin < tExpiration)
+		return;
+	if ((tNow < tExpiration) && (tNow < tLastFailure + TOKEN_REFRESH_RETRY_DELAY))
+		return;
+
+	std::unique_lock<std::mutex> refreshlock(m_mtxTokenRefresh, std::try_to_lock);
+	if (!refreshlock.owns_lock())
+	{
+		if (time(NULL) < tExpiration)
+			return;
+		refreshlock.lock();
+	}
+
+	{
+		// check whether another thread completed the renewal while we waited
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+		if (m_tTokenExpirationTime != tExpiration)
+			return;
+	}
+	bool bRenewed = renew_session();
 
-	return request_user_id();
+	std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+	m_tTokenRefreshFailed = bRenewed ? 0 : time(NULL);
 }
 
 
-/* private */ bool EvohomeClient2::request_user_id()
+/*
+ * Return a copy of the request header, renewing the session first if required
+ */
+/* private */ std::vector<std::string> EvohomeClient2::get_auth_header()
 {
-	m_szResponse = "";
+	check_token_refresh();
+	std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+	return m_vEvoHeader;
+}
 
-	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::userAccount);
-	EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
 
-	Json::Value jUserAccount;
-	if (evohome::parse_json_string(m_szResponse, jUserAccount) < 0)
+/*
+ * Load authorization key from a backup file
+ *
+ * If the token has expired the renewal is coordinated with other processes that use
+ * the same file: the first one to lock it renews, the others pick up the new token.
+ */
+bool EvohomeClient2::load_auth_from_file(const std::string &szFilename)
+{
+	Json::Value jAuth;
+	int lockHandle = SharedAuthFile::lock(szFilename, false);
+	bool bRead = read_auth_file(szFilename, jAuth);
+	SharedAuthFile::unlock(lockHandle);
+	if (!bRead)
 	{
-		m_szLastError = evohome::messages::invalidResponse;
-		m_szUserId = "";
+		m_szLastError = evohome::messages::invalidAuthfile;
 		return false;
 	}
 
-	m_szUserId = jUserAccount["userId"].asString();
-	if (m_szUserId.empty())
+	m_szUserId = "";
+	set_auth_from_json(jAuth);
+	m_szAuthFile = szFilename;
+
+	if (!is_session_valid())
+		return renew_login();
+
+	if (!m_szUserId.empty()) // fast start: session restored without contacting the portal
+		return true;
+	return request_user_id(m_szResponse);
+}
+
+
+/* private */ bool EvohomeClient2::request_user_id(std::string &szResponse)
+{
+	szResponse = "";
+
+	std::vector<std::string> vEvoHeader;
 	{
-		m_szLastError = evohome::messages::unhandledResponse;
-		return false;
+		std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+		vEvoHeader = m_vEvoHeader;
 	}
-	return true;
+
+	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::userAccount);
+	EvoHTTPBridge::SafeGET(szUrl, vEvoHeader, szResponse, -1);
+
+	Json::Value jUserAccount;
+	std::string szUserId;
+	if (evohome::parse_json_string(szResponse, jUserAccount) < 0)
+		m_szLastError = evohome::messages::invalidResponse;
+	else
+	{
+		szUserId = jUserAccount["userId"].asString();
+		if (szUserId.empty())
+			m_szLastError = evohome::messages::unhandledResponse;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtxAuthHeader);
+	m_szUserId = szUserId;
+	return !m_szUserId.empty();
 }
 
 
@@ -394,11 +625,22 @@ bool EvohomeClient2::full_installation()
 {
 	m_szResponse = "";
 
-	std::vector<evohome::device::location>().swap(m_vLocations);
-	std::vector<evohome::device::path::zone>().swap(m_vZonePaths);
-
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::installationInfo, m_szUserId);
-	EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
+	if (m_vLocations.empty())
+		m_mValidators.erase(szUrl);
+
+	bool bModified;
+	m_vInstallationChanges.clear();
+	bool bhttpOK = conditional_get(szUrl, bModified);
+	if (bhttpOK && !bModified)
+		return true;
+
+	if (!bhttpOK || m_szResponse.empty())
+	{
+		m_szLastError = evohome::messages::unhandledResponse;
+		m_mValidators.erase(szUrl);
+		return false;
+	}
 
 	if (m_szResponse[0] == '[')
 	{
@@ -407,13 +649,40 @@ bool EvohomeClient2::full_installation()
 		m_szResponse.append("}");
 	}
 
-	m_jFullInstallation.clear();
-	if (evohome::parse_json_string(m_szResponse, m_jFullInstallation) < 0)
+	Json::Value jInstallation;
+	bool bParsed;
+	if (m_bInstallationFilter)
+		bParsed = JsonSaxReader::parse_filtered(m_szResponse, m_vInstallationFields, jInstallation);
+	else
+		bParsed = (evohome::parse_json_string(m_szResponse, jInstallation) >= 0);
+	if (!bParsed)
 	{
 		m_szLastError = evohome::messages::invalidResponse;
+		m_mValidators.erase(szUrl);
+		return false;
+	}
+	if (!jInstallation.isObject() || !jInstallation["locations"].isArray())
+	{
+		// error object such as an expired session: keep the installation we have
+		m_szLastError = evohome::messages::unhandledResponse;
+		m_mValidators.erase(szUrl);
 		return false;
 	}
 
+	bool bReconcile = (m_bIncrementalInstallation && !m_vLocations.empty());
+	if (!bReconcile)
+	{
+		std::vector<evohome::device::location>().swap(m_vLocations);
+		std::vector<evohome::device::path::zone>().swap(m_vZonePaths);
+	}
+	m_jFullInstallation.swap(jInstallation);
+
+	if (bReconcile)
+	{
+		reconcile_locations();
+		return true;
+	}
+
 	int l = static_cast<int>(m_jFullInstallation["locations"].size());
 	for (int i = 0; i < l; i++)
 	{
@@ -429,56 +698,365 @@ bool EvohomeClient2::full_installation()
 }
 
 
-/************************************************************************
- *									*
- *	Evohome system status retrieval					*
- *									*
- ************************************************************************/
+const std::vector<evohome::device::diff::change> &EvohomeClient2::get_installation_changes()
+{
+	return m_vInstallationChanges;
+}
 
 
 /*
- * Retrieve evohome status info
+ * Record a structural change of the installation
  */
-bool EvohomeClient2::get_status(const unsigned int locationIdx)
+static void add_device_change(std::vector<evohome::device::diff::change> &vChanges, const evohome::device::diff::type::value eType, const evohome::device::diff::kind::value eKind, const std::string &szObjectId, const std::string &szParentId)
 {
-	m_szResponse = "";
-	if (locationIdx >= static_cast<unsigned int>(m_vLocations.size()))
+	evohome::device::diff::change newchange = evohome::device::diff::change();
+	newchange.eType = eType;
+	newchange.eKind = eKind;
+	newchange.szObjectId = szObjectId;
+	newchange.szParentId = szParentId;
+	vChanges.push_back(newchange);
+}
+
+
+/*
+ * Arrange a list of devices in the order of vIds, matching existing devices on their ID
+ *
+ * A list that already holds these IDs in this order is not touched. Otherwise it is
+ * rebuilt: existing devices are moved into place, which leaves the memory of their own
+ * device lists in place, new devices are value initialized and the rest is destroyed.
+ */
+template <typename T>
+static void reconcile_devices(std::vector<T> &vDevices, const std::vector<std::string> &vIds, std::string T::*szId, const evohome::device::diff::kind::value eKind, const std::string &szParentId, std::vector<evohome::device::diff::change> &vChanges)
+{
+	bool bUnchanged = (vDevices.size() == vIds.size());
+	for (size_t i = 0; bUnchanged && (i < vIds.size()); i++)
+		bUnchanged = (vDevices[i].*szId == vIds[i]);
+	if (bUnchanged)
+		return;
+
+	std::vector<T> vNewDevices(vIds.size());
+	std::vector<bool> vMatched(vDevices.size(), false);
+	for (size_t i = 0; i < vIds.size(); i++)
 	{
-		m_szLastError = "Invalid location ID";
-		return false;
+		size_t j = 0;
+		while ((j < vDevices.size()) && (vMatched[j] || (vDevices[j].*szId != vIds[i])))
+			j++;
+		if (j < vDevices.size())
+		{
+			vNewDevices[i] = std::move(vDevices[j]);
+			vMatched[j] = true;
+			add_device_change(vChanges, evohome::device::diff::type::moved, eKind, vIds[i], szParentId);
+		}
+		else
+		{
+			vNewDevices[i].*szId = vIds[i];
+			add_device_change(vChanges, evohome::device::diff::type::added, eKind, vIds[i], szParentId);
+		}
 	}
-
-	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::status, m_vLocations[locationIdx].szLocationId);
-	if (!EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1))
+	for (size_t j = 0; j < vDevices.size(); j++)
 	{
-		m_szLastError = "HTTP error during fetch status";
-		return false;
+		if (!vMatched[j])
+			add_device_change(vChanges, evohome::device::diff::type::removed, eKind, vDevices[j].*szId, szParentId);
 	}
+	vDevices.swap(vNewDevices);
+}
+
 
-	m_vLocations[locationIdx].jStatus.clear();
-	if (evohome::parse_json_string(m_szResponse, m_vLocations[locationIdx].jStatus) < 0)
+/*
+ * Update the existing structs to a changed installation
+ *
+ * Installation pointers and indexes are renewed for every device, everything else
+ * is kept for devices that remain. Zone paths are rebuilt.
+ */
+/* private */ void EvohomeClient2::reconcile_locations()
+{
+	std::vector<evohome::device::path::zone>().swap(m_vZonePaths);
+
+	Json::Value *jLocations = &m_jFullInstallation["locations"];
+	std::vector<std::string> vIds;
+	int l = ((*jLocations).isArray()) ? static_cast<int>((*jLocations).size()) : 0;
+	for (int i = 0; i < l; i++)
+		vIds.push_back((*jLocations)[i]["locationInfo"]["locationId"].asString());
+	reconcile_devices(m_vLocations, vIds, &evohome::device::location::szLocationId, evohome::device::diff::kind::location, std::string(), m_vInstallationChanges);
+
+	for (int i = 0; i < l; i++)
 	{
-		m_szLastError = evohome::messages::invalidResponse;
-		return false;
+		m_vLocations[i].jInstallationInfo = &(*jLocations)[i];
+		m_vLocations[i].locationIdx = i;
+		reconcile_gateways(i);
 	}
-	Json::Value *jLocation = &m_vLocations[locationIdx].jStatus;
+}
 
-	// get gateway status
-	if (!(*jLocation)["gateways"].isArray())
+
+/* private */ void EvohomeClient2::reconcile_gateways(const unsigned int locationIdx)
+{
+	evohome::device::location *myLocation = &m_vLocations[locationIdx];
+	Json::Value *jGateways = &(*myLocation->jInstallationInfo)["gateways"];
+	std::vector<std::string> vIds;
+	int l = ((*jGateways).isArray()) ? static_cast<int>((*jGateways).size()) : 0;
+	for (int i = 0; i < l; i++)
+		vIds.push_back((*jGateways)[i]["gatewayInfo"]["gatewayId"].asString());
+	reconcile_devices((*myLocation).gateways, vIds, &evohome::device::gateway::szGatewayId, evohome::device::diff::kind::gateway, (*myLocation).szLocationId, m_vInstallationChanges);
+
+	for (int i = 0; i < l; i++)
 	{
-		m_szLastError = "No gateway found";
-		return false;
+		(*myLocation).gateways[i].jInstallationInfo = &(*jGateways)[i];
+		(*myLocation).gateways[i].locationIdx = locationIdx;
+		(*myLocation).gateways[i].gatewayIdx = i;
+		reconcile_temperatureControlSystems(locationIdx, i);
 	}
+}
 
-	int lgw = static_cast<int>((*jLocation)["gateways"].size());
-	for (int igw = 0; igw < lgw; igw++)
-	{
-		std::string szGatewayId = (*jLocation)["gateways"][igw]["gatewayId"].asString();
-		evohome::device::gateway *_tGateway = get_gateway_by_ID(szGatewayId);
-		_tGateway->jStatus = &(*jLocation)["gateways"][igw];
 
-		// get temperatureControlSystem status
-		if (!(*_tGateway->jStatus)["temperatureControlSystems"].isArray())
+/* private */ void EvohomeClient2::reconcile_temperatureControlSystems(const unsigned int locationIdx, const unsigned int gatewayIdx)
+{
+	evohome::device::gateway *myGateway = &m_vLocations[locationIdx].gateways[gatewayIdx];
+	Json::Value *jTCSs = &(*myGateway->jInstallationInfo)["temperatureControlSystems"];
+	std::vector<std::string> vIds;
+	int l = ((*jTCSs).isArray()) ? static_cast<int>((*jTCSs).size()) : 0;
+	for (int i = 0; i < l; i++)
+		vIds.push_back((*jTCSs)[i]["systemId"].asString());
+	reconcile_devices((*myGateway).temperatureControlSystems, vIds, &evohome::device::temperatureControlSystem::szSystemId, evohome::device::diff::kind::temperatureControlSystem, (*myGateway).szGatewayId, m_vInstallationChanges);
+
+	for (int i = 0; i < l; i++)
+	{
+		(*myGateway).temperatureControlSystems[i].jInstallationInfo = &(*jTCSs)[i];
+		(*myGateway).temperatureControlSystems[i].locationIdx = locationIdx;
+		(*myGateway).temperatureControlSystems[i].gatewayIdx = gatewayIdx;
+		(*myGateway).temperatureControlSystems[i].systemIdx = i;
+		reconcile_zones(locationIdx, gatewayIdx, i);
+	}
+}
+
+
+/* private */ void EvohomeClient2::reconcile_zones(const unsigned int locationIdx, const unsigned int gatewayIdx, const unsigned int systemIdx)
+{
+	evohome::device::temperatureControlSystem *myTCS = &m_vLocations[locationIdx].gateways[gatewayIdx].temperatureControlSystems[systemIdx];
+	Json::Value *jTCS = (*myTCS).jInstallationInfo;
+	Json::Value *jZones = &(*jTCS)["zones"];
+	std::vector<std::string> vIds;
+	int l = ((*jZones).isArray()) ? static_cast<int>((*jZones).size()) : 0;
+	for (int i = 0; i < l; i++)
+		vIds.push_back((*jZones)[i]["zoneId"].asString());
+	reconcile_devices((*myTCS).zones, vIds, &evohome::device::zone::szZoneId, evohome::device::diff::kind::zone, (*myTCS).szSystemId, m_vInstallationChanges);
+
+	vIds.clear();
+	if ((*jTCS).isMember("dhw"))
+		vIds.push_back((*jTCS)["dhw"]["dhwId"].asString());
+	reconcile_devices((*myTCS).dhw, vIds, &evohome::device::zone::szZoneId, evohome::device::diff::kind::dhw, (*myTCS).szSystemId, m_vInstallationChanges);
+
+	int numZones = l + static_cast<int>((*myTCS).dhw.size());
+	for (int i = 0; i < numZones; i++)
+	{
+		evohome::device::zone *myZone = (i < l) ? &(*myTCS).zones[i] : &(*myTCS).dhw[0];
+		(*myZone).jInstallationInfo = (i < l) ? &(*jZones)[i] : &(*jTCS)["dhw"];
+		(*myZone).zoneIdx = (i < l) ? i : 128;
+		(*myZone).systemIdx = systemIdx;
+		(*myZone).gatewayIdx = gatewayIdx;
+		(*myZone).locationIdx = locationIdx;
+
+		evohome::device::path::zone newzonepath = evohome::device::path::zone();
+		newzonepath.locationIdx = locationIdx;
+		newzonepath.gatewayIdx = gatewayIdx;
+		newzonepath.systemIdx = systemIdx;
+		newzonepath.zoneIdx = (*myZone).zoneIdx;
+		newzonepath.szZoneId = (*myZone).szZoneId;
+		m_vZonePaths.push_back(newzonepath);
+	}
+}
+
+
+/*
+ * Only keep the installation members that the library uses
+ *
+ * Takes effect on the next call to full_installation(), which will not send
+ * validators for the installation so that the portal returns the full response.
+ */
+void EvohomeClient2::set_installation_filter(const bool bEnable)
+{
+	m_bInstallationFilter = bEnable;
+	m_mValidators.erase(evohome::API2::uri::get_uri(evohome::API2::uri::installationInfo, m_szUserId));
+}
+
+
+void EvohomeClient2::add_installation_field(const std::string &szPath)
+{
+	if (std::find(m_vInstallationFields.begin(), m_vInstallationFields.end(), szPath) == m_vInstallationFields.end())
+		m_vInstallationFields.push_back(szPath);
+	m_mValidators.erase(evohome::API2::uri::get_uri(evohome::API2::uri::installationInfo, m_szUserId));
+}
+
+
+/*
+ * Drop installation, status and schedule data while keeping the session
+ */
+void EvohomeClient2::release_installation()
+{
+	std::vector<evohome::device::location>().swap(m_vLocations);
+	std::vector<evohome::device::path::zone>().swap(m_vZonePaths);
+	Json::Value().swap(m_jFullInstallation);
+	std::vector<evohome::device::diff::change>().swap(m_vInstallationChanges);
+	m_iStatusGeneration++;
+	m_mValidators.clear();
+	std::vector<evohome::event::change>().swap(m_vStatusChanges);
+	std::atomic_store(&m_pStatusSnapshot, std::shared_ptr<const evohome::status::snapshot>());
+	std::string().swap(m_szResponse);
+}
+
+
+/*
+ * Perform a GET request for content that we keep a parsed copy of
+ *
+ * Validators from the previous response are sent back to the portal. If the
+ * portal answers 304 'Not Modified', bModified is set to false and the caller
+ * should keep its current parsed tree.
+ */
+/* private */ bool EvohomeClient2::conditional_get(const std::string &szUrl, bool &bModified)
+{
+	bModified = true;
+	std::vector<std::string> vRequestHeader = get_auth_header();
+	std::map<std::string, evohome::API::request::validator>::iterator it = m_mValidators.find(szUrl);
+	if (it != m_mValidators.end())
+	{
+		if (!it->second.szETag.empty())
+			vRequestHeader.push_back("If-None-Match: " + it->second.szETag);
+		if (!it->second.szLastModified.empty())
+			vRequestHeader.push_back("If-Modified-Since: " + it->second.szLastModified);
+	}
+
+	std::vector<std::string> vHeaderData;
+	bool bhttpOK = EvoHTTPBridge::SafeGET(szUrl, vRequestHeader, m_szResponse, vHeaderData, -1);
+
+	int httpStatus = EvoHTTPBridge::GetHTTPStatus(vHeaderData);
+	if ((httpStatus == 304) && (it != m_mValidators.end()))
+	{
+		bModified = false;
+		return true;
+	}
+
+	evohome::API::request::validator newValidator;
+	newValidator.szETag = EvoHTTPBridge::GetHeaderValue(vHeaderData, "ETag");
+	newValidator.szLastModified = EvoHTTPBridge::GetHeaderValue(vHeaderData, "Last-Modified");
+	if ((httpStatus == 200) && (!newValidator.szETag.empty() || !newValidator.szLastModified.empty()))
+		m_mValidators[szUrl] = newValidator;
+	else
+		m_mValidators.erase(szUrl);
+	return bhttpOK;
+}
+
+
+/************************************************************************
+ *									*
+ *	Evohome system status retrieval					*
+ *									*
+ ************************************************************************/
+
+
+/*
+ * Retrieve evohome status info
+ */
+bool EvohomeClient2::get_status(const unsigned int locationIdx)
+{
+	m_szResponse = "";
+	m_vStatusChanges.clear();
+	m_iStatusGeneration++;
+	if (locationIdx >= static_cast<unsigned int>(m_vLocations.size()))
+	{
+		m_szLastError = "Invalid location ID";
+		return false;
+	}
+
+	// a status tree is shared with concurrent identical requests unless it is decoded or parsed into an arena
+	bool bUseArena = (m_bStatusArena && !(m_bIncrementalStatus && m_vLocations[locationIdx].jStatus.isObject()));
+	std::shared_ptr<const Json::Value> pSharedStatus;
+	bool bhttpOK;
+	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::status, m_vLocations[locationIdx].szLocationId);
+	if (m_bTypedStatus || bUseArena)
+		bhttpOK = EvoHTTPBridge::SafeGET(szUrl, get_auth_header(), m_szResponse, -1);
+	else
+	{
+		std::vector<std::string> vHeaderData;
+		bhttpOK = EvoHTTPBridge::SafeGET(szUrl, get_auth_header(), m_szResponse, vHeaderData, pSharedStatus, -1);
+	}
+	if (!bhttpOK)
+	{
+		m_szLastError = "HTTP error during fetch status";
+		return false;
+	}
+
+	if (m_bTypedStatus)
+	{
+		if (!StatusDecoder::decode(m_szResponse, m_statusDecoded))
+		{
+			m_szLastError = evohome::messages::invalidResponse;
+			return false;
+		}
+		if (m_statusDecoded.vGatewayIds.empty())
+		{
+			m_szLastError = "No gateway found";
+			return false;
+		}
+
+		apply_typed_status(locationIdx);
+
+		if (m_fStatusChangeCallback)
+		{
+			for (std::vector<evohome::event::change>::iterator it = m_vStatusChanges.begin(); it != m_vStatusChanges.end(); ++it)
+				m_fStatusChangeCallback(*it);
+		}
+		return true;
+	}
+
+	// declared before jNewStatus so that it outlives the tree that is replaced
+	std::shared_ptr<Json::Arena> pStatusArena;
+	if (bUseArena)
+		pStatusArena = std::make_shared<Json::Arena>();
+
+	Json::Value jNewStatus;
+	int parseResult = 0;
+	if (bUseArena)
+	{
+		Json::Arena::Scope arenaScope(*pStatusArena);
+		parseResult = evohome::parse_json_string(m_szResponse, jNewStatus);
+	}
+	else if (pSharedStatus)
+		EvoHTTPBridge::TakeParsed(pSharedStatus, jNewStatus);
+	else
+		parseResult = -1;
+	if (parseResult < 0)
+	{
+		m_szLastError = evohome::messages::invalidResponse;
+		return false;
+	}
+
+	// get gateway status
+	if (!jNewStatus["gateways"].isArray())
+	{
+		m_szLastError = "No gateway found";
+		return false;
+	}
+
+	collect_status_changes(locationIdx, jNewStatus);
+
+	Json::Value *jLocation = &m_vLocations[locationIdx].jStatus;
+	if (m_bIncrementalStatus && (*jLocation).isObject())
+		merge_status(*jLocation, jNewStatus);
+	else
+	{
+		(*jLocation).swap(jNewStatus);
+		// the previous tree and its arena are released on return
+		m_vLocations[locationIdx].statusArena.swap(pStatusArena);
+	}
+
+	int lgw = static_cast<int>((*jLocation)["gateways"].size());
+	for (int igw = 0; igw < lgw; igw++)
+	{
+		std::string szGatewayId = (*jLocation)["gateways"][igw]["gatewayId"].asString();
+		evohome::device::gateway *_tGateway = get_gateway_by_ID(szGatewayId);
+		_tGateway->jStatus = &(*jLocation)["gateways"][igw];
+
+		// get temperatureControlSystem status
+		if (!(*_tGateway->jStatus)["temperatureControlSystems"].isArray())
 		{
 			m_szLastError = "No temperature control system found";
 			return false;
@@ -512,10 +1090,328 @@ bool EvohomeClient2::get_status(const unsigned int locationIdx)
 			}
 		}
 	}
+
+	if (m_bStatusSnapshots)
+		publish_status_snapshot(locationIdx);
+
+	if (m_fStatusChangeCallback)
+	{
+		for (std::vector<evohome::event::change>::iterator it = m_vStatusChanges.begin(); it != m_vStatusChanges.end(); ++it)
+			m_fStatusChangeCallback(*it);
+	}
 	return true;
 }
 
 
+/*
+ * Compare a newly retrieved status tree against the current values of the devices
+ */
+/* private */ void EvohomeClient2::collect_status_changes(const unsigned int locationIdx, const Json::Value &jNewStatus)
+{
+	const Json::Value &jGateways = jNewStatus["gateways"];
+	int lgw = static_cast<int>(jGateways.size());
+	for (int igw = 0; igw < lgw; igw++)
+	{
+		const Json::Value &jSystems = jGateways[igw]["temperatureControlSystems"];
+		if (!jSystems.isArray())
+			continue;
+
+		int ltcs = static_cast<int>(jSystems.size());
+		for (int itcs = 0; itcs < ltcs; itcs++)
+		{
+			const Json::Value &jTCS = jSystems[itcs];
+			std::string szSystemId = jTCS["systemId"].asString();
+			evohome::device::temperatureControlSystem *_tTCS = get_temperatureControlSystem_by_ID(szSystemId);
+			if ((_tTCS == NULL) || (_tTCS->jStatus == NULL))
+				continue;
+
+			const Json::Value &jOldTCS = *_tTCS->jStatus;
+			add_status_change(evohome::event::type::systemMode, locationIdx, szSystemId, jOldTCS["systemModeStatus"]["mode"], jTCS["systemModeStatus"]["mode"]);
+			add_status_change(evohome::event::type::systemModeUntil, locationIdx, szSystemId, jOldTCS["systemModeStatus"]["timeUntil"], jTCS["systemModeStatus"]["timeUntil"]);
+
+			const Json::Value &jZones = jTCS["zones"];
+			int lz = static_cast<int>(jZones.size());
+			for (int iz = 0; iz < lz; iz++)
+			{
+				std::string szZoneId = jZones[iz]["zoneId"].asString();
+				evohome::device::zone *_tZone = get_zone_by_ID(szZoneId);
+				if ((_tZone == NULL) || (_tZone->jStatus == NULL))
+					continue;
+
+				const Json::Value &jOldZone = *_tZone->jStatus;
+				add_status_change(evohome::event::type::zoneTemperature, locationIdx, szZoneId, jOldZone["temperatureStatus"]["temperature"], jZones[iz]["temperatureStatus"]["temperature"]);
+				add_status_change(evohome::event::type::zoneSetpoint, locationIdx, szZoneId, jOldZone["setpointStatus"]["targetHeatTemperature"], jZones[iz]["setpointStatus"]["targetHeatTemperature"]);
+				add_status_change(evohome::event::type::zoneMode, locationIdx, szZoneId, jOldZone["setpointStatus"]["setpointMode"], jZones[iz]["setpointStatus"]["setpointMode"]);
+				add_status_change(evohome::event::type::zoneModeUntil, locationIdx, szZoneId, jOldZone["setpointStatus"]["until"], jZones[iz]["setpointStatus"]["until"]);
+			}
+
+			if (has_dhw(_tTCS) && (_tTCS->dhw[0].jStatus != NULL) && jTCS.isMember("dhw"))
+			{
+				const Json::Value &jOldDHW = *_tTCS->dhw[0].jStatus;
+				const Json::Value &jDHW = jTCS["dhw"];
+				std::string szDHWId = _tTCS->dhw[0].szZoneId;
+				add_status_change(evohome::event::type::dhwTemperature, locationIdx, szDHWId, jOldDHW["temperatureStatus"]["temperature"], jDHW["temperatureStatus"]["temperature"]);
+				add_status_change(evohome::event::type::dhwState, locationIdx, szDHWId, jOldDHW["stateStatus"]["state"], jDHW["stateStatus"]["state"]);
+				add_status_change(evohome::event::type::dhwMode, locationIdx, szDHWId, jOldDHW["stateStatus"]["mode"], jDHW["stateStatus"]["mode"]);
+				add_status_change(evohome::event::type::dhwModeUntil, locationIdx, szDHWId, jOldDHW["stateStatus"]["until"], jDHW["stateStatus"]["until"]);
+			}
+		}
+	}
+}
+
+
+/* private */ void EvohomeClient2::add_status_change(const evohome::event::type::value eType, const unsigned int locationIdx, const std::string &szObjectId, const Json::Value &jOld, const Json::Value &jNew)
+{
+	if (jOld == jNew)
+		return;
+
+	add_status_change(eType, locationIdx, szObjectId, jOld.asString(), jNew.asString());
+}
+/* private */ void EvohomeClient2::add_status_change(const evohome::event::type::value eType, const unsigned int locationIdx, const std::string &szObjectId, const std::string &szOld, const std::string &szNew)
+{
+	if (szOld == szNew)
+		return;
+
+	evohome::event::change newChange = evohome::event::change();
+	newChange.eType = eType;
+	newChange.locationIdx = locationIdx;
+	newChange.szObjectId = szObjectId;
+	newChange.szOldValue = szOld;
+	newChange.szNewValue = szNew;
+	m_vStatusChanges.push_back(newChange);
+}
+
+
+/*
+ * Store a decoded location status in the status structs of its devices
+ *
+ * The json status tree of the location is dropped and all of its jStatus pointers
+ * are cleared. Changes are collected against the previously decoded values.
+ */
+/* private */ void EvohomeClient2::apply_typed_status(const unsigned int locationIdx)
+{
+	evohome::device::location *myLocation = &m_vLocations[locationIdx];
+	Json::Value().swap(myLocation->jStatus);
+	myLocation->statusArena.reset();
+	for (std::vector<evohome::device::gateway>::iterator gw = myLocation->gateways.begin(); gw != myLocation->gateways.end(); ++gw)
+	{
+		(*gw).jStatus = NULL;
+		for (std::vector<evohome::device::temperatureControlSystem>::iterator tcs = (*gw).temperatureControlSystems.begin(); tcs != (*gw).temperatureControlSystems.end(); ++tcs)
+		{
+			(*tcs).jStatus = NULL;
+			for (std::vector<evohome::device::zone>::iterator zone = (*tcs).zones.begin(); zone != (*tcs).zones.end(); ++zone)
+				(*zone).jStatus = NULL;
+			for (std::vector<evohome::device::zone>::iterator zone = (*tcs).dhw.begin(); zone != (*tcs).dhw.end(); ++zone)
+				(*zone).jStatus = NULL;
+		}
+	}
+
+	for (std::vector<std::pair<std::string, evohome::device::status::system> >::iterator it = m_statusDecoded.vSystems.begin(); it != m_statusDecoded.vSystems.end(); ++it)
+	{
+		evohome::device::temperatureControlSystem *_tTCS = get_temperatureControlSystem_by_ID(it->first);
+		if (_tTCS == NULL)
+			continue;
+
+		const evohome::device::status::system &oldStatus = _tTCS->status;
+		const evohome::device::status::system &newStatus = it->second;
+		if (oldStatus.bValid)
+		{
+			add_status_change(evohome::event::type::systemMode, locationIdx, it->first,
+				(oldStatus.mode < 0) ? "" : evohome::API2::system::mode[oldStatus.mode],
+				(newStatus.mode < 0) ? "" : evohome::API2::system::mode[newStatus.mode]);
+			add_status_change(evohome::event::type::systemModeUntil, locationIdx, it->first, format_until(oldStatus.tUntil), format_until(newStatus.tUntil));
+		}
+		std::swap(_tTCS->status, it->second);
+	}
+
+	for (std::vector<std::pair<std::string, evohome::device::status::zone> >::iterator it = m_statusDecoded.vZones.begin(); it != m_statusDecoded.vZones.end(); ++it)
+	{
+		evohome::device::zone *_tZone = get_zone_by_ID(it->first);
+		if (_tZone == NULL)
+			continue;
+
+		const evohome::device::status::zone &oldStatus = _tZone->status;
+		const evohome::device::status::zone &newStatus = it->second;
+		if (oldStatus.bValid)
+		{
+			std::string szOldMode = (oldStatus.mode < 0) ? "" : evohome::API2::zone::mode[oldStatus.mode];
+			std::string szNewMode = (newStatus.mode < 0) ? "" : evohome::API2::zone::mode[newStatus.mode];
+			if (_tZone->zoneIdx & 128)
+			{
+				add_status_change(evohome::event::type::dhwTemperature, locationIdx, it->first, format_temperature(oldStatus), format_temperature(newStatus));
+				add_status_change(evohome::event::type::dhwState, locationIdx, it->first,
+					(oldStatus.state < 0) ? "" : evohome::API2::dhw::state[oldStatus.state],
+					(newStatus.state < 0) ? "" : evohome::API2::dhw::state[newStatus.state]);
+				add_status_change(evohome::event::type::dhwMode, locationIdx, it->first, szOldMode, szNewMode);
+				add_status_change(evohome::event::type::dhwModeUntil, locationIdx, it->first, format_until(oldStatus.tUntil), format_until(newStatus.tUntil));
+			}
+			else
+			{
+				add_status_change(evohome::event::type::zoneTemperature, locationIdx, it->first, format_temperature(oldStatus), format_temperature(newStatus));
+				add_status_change(evohome::event::type::zoneSetpoint, locationIdx, it->first, Json::valueToString(oldStatus.dSetpoint), Json::valueToString(newStatus.dSetpoint));
+				add_status_change(evohome::event::type::zoneMode, locationIdx, it->first, szOldMode, szNewMode);
+				add_status_change(evohome::event::type::zoneModeUntil, locationIdx, it->first, format_until(oldStatus.tUntil), format_until(newStatus.tUntil));
+			}
+		}
+		std::swap(_tZone->status, it->second);
+	}
+}
+
+
+/* private */ std::string EvohomeClient2::format_temperature(const evohome::device::status::zone &statusZone)
+{
+	if (!statusZone.bTemperatureAvailable)
+		return "";
+	return Json::valueToString(statusZone.dTemperature);
+}
+
+
+/* private */ std::string EvohomeClient2::format_until(const time_t tUntil)
+{
+	if (tUntil <= 0)
+		return "";
+	return IsoTimeString::time_t_to_utc(tUntil);
+}
+
+
+/*
+ * Publish a new immutable snapshot that holds a copy of the location's current status
+ *
+ * Status of other locations is shared with the previous snapshot. Readers that still
+ * hold the previous snapshot are not affected.
+ */
+/* private */ void EvohomeClient2::publish_status_snapshot(const unsigned int locationIdx)
+{
+	std::shared_ptr<const evohome::status::snapshot> pCurrent = std::atomic_load(&m_pStatusSnapshot);
+	std::shared_ptr<evohome::status::snapshot> pNew = std::make_shared<evohome::status::snapshot>();
+
+	pNew->serial = (pCurrent) ? pCurrent->serial + 1 : 1;
+	pNew->tRetrieved = time(NULL);
+	if (pCurrent)
+		pNew->locations = pCurrent->locations;
+	pNew->locations.resize(m_vLocations.size());
+	pNew->locations[locationIdx] = std::make_shared<const Json::Value>(m_vLocations[locationIdx].jStatus);
+
+	int numLocations = static_cast<int>(pNew->locations.size());
+	for (int il = 0; il < numLocations; il++)
+	{
+		if (!pNew->locations[il])
+			continue;
+		const Json::Value &jGateways = (*pNew->locations[il])["gateways"];
+		int lgw = static_cast<int>(jGateways.size());
+		for (int igw = 0; igw < lgw; igw++)
+		{
+			const Json::Value &jSystems = jGateways[igw]["temperatureControlSystems"];
+			int ltcs = static_cast<int>(jSystems.size());
+			for (int itcs = 0; itcs < ltcs; itcs++)
+			{
+				const Json::Value &jTCS = jSystems[itcs];
+				pNew->systems[jTCS["systemId"].asString()] = &jTCS;
+
+				const Json::Value &jZones = jTCS["zones"];
+				int lz = static_cast<int>(jZones.size());
+				for (int iz = 0; iz < lz; iz++)
+					pNew->zones[jZones[iz]["zoneId"].asString()] = &jZones[iz];
+
+				if (jTCS.isMember("dhw"))
+					pNew->zones[jTCS["dhw"]["dhwId"].asString()] = &jTCS["dhw"];
+			}
+		}
+	}
+
+	std::shared_ptr<const evohome::status::snapshot> pPublish = pNew;
+	std::atomic_store(&m_pStatusSnapshot, pPublish);
+}
+
+
+/*
+ * Return the most recently published status snapshot (may be empty)
+ */
+std::shared_ptr<const evohome::status::snapshot> EvohomeClient2::get_status_snapshot()
+{
+	return std::atomic_load(&m_pStatusSnapshot);
+}
+
+
+const std::vector<evohome::event::change> &EvohomeClient2::get_status_changes()
+{
+	return m_vStatusChanges;
+}
+
+
+void EvohomeClient2::set_status_change_callback(evohome::event::callback fCallback)
+{
+	m_fStatusChangeCallback = fCallback;
+}
+
+
+void EvohomeClient2::set_typed_status(const bool bEnable)
+{
+	m_bTypedStatus = bEnable;
+}
+
+
+/*
+ * Merge a newly retrieved status tree into the current one
+ *
+ * Only values that changed are rewritten. Existing nodes keep their address unless
+ * their type changes or an array no longer lists the same objects at the same index.
+ */
+/* private */ void EvohomeClient2::merge_status(Json::Value &jCurrent, Json::Value &jUpdate)
+{
+	if (jCurrent.type() != jUpdate.type())
+	{
+		jCurrent.swap(jUpdate);
+		return;
+	}
+
+	if (jCurrent.isObject())
+	{
+		Json::Value::Members currentMembers = jCurrent.getMemberNames();
+		for (std::vector<std::string>::iterator it = currentMembers.begin(); it != currentMembers.end(); ++it)
+		{
+			if (!jUpdate.isMember(*it))
+				jCurrent.removeMember(*it);
+		}
+		Json::Value::Members updateMembers = jUpdate.getMemberNames();
+		for (std::vector<std::string>::iterator it = updateMembers.begin(); it != updateMembers.end(); ++it)
+			merge_status(jCurrent[*it], jUpdate[*it]);
+		return;
+	}
+
+	if (jCurrent.isArray())
+	{
+		static const char* idKeys[4] = {"zoneId", "dhwId", "systemId", "gatewayId"};
+		int l = static_cast<int>(jUpdate.size());
+		int lc = static_cast<int>(jCurrent.size());
+		for (int i = 0; (i < l) && (i < lc); i++)
+		{
+			const Json::Value &jCurrentItem = jCurrent[i];
+			const Json::Value &jUpdateItem = jUpdate[i];
+			if (!jCurrentItem.isObject() || !jUpdateItem.isObject())
+				continue;
+			for (int k = 0; k < 4; k++)
+			{
+				// const access: a missing key must not be added to either tree
+				if (jCurrentItem.isMember(idKeys[k]) && (!jUpdateItem.isMember(idKeys[k]) || (jCurrentItem[idKeys[k]] != jUpdateItem[idKeys[k]])))
+				{
+					// objects moved to a different position
+					jCurrent.swap(jUpdate);
+					return;
+				}
+			}
+		}
+		jCurrent.resize(l);
+		for (int i = 0; i < l; i++)
+			merge_status(jCurrent[i], jUpdate[i]);
+		return;
+	}
+
+	if (jCurrent != jUpdate)
+		jCurrent.swap(jUpdate);
+}
+
+
 bool EvohomeClient2::get_status(const std::string szLocationId)
 {
 	if (m_vLocations.size() == 0)
@@ -677,7 +1573,7 @@ evohome::device::temperatureControlSystem *EvohomeClient2::get_zone_temperatureC
 std::string EvohomeClient2::request_next_switchpoint(const std::string szZoneId)
 {
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneUpcoming, szZoneId, 0);
-	EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
+	EvoHTTPBridge::SafeGET(szUrl, get_auth_header(), m_szResponse, -1);
 
 	Json::Value jSwitchPoint;
 	if (evohome::parse_json_string(m_szResponse, jSwitchPoint) < 0)
@@ -706,20 +1602,33 @@ bool EvohomeClient2::get_dhw_schedule(const std::string szDHWId)
 /* private */ bool EvohomeClient2::get_zone_schedule_ex(const std::string szZoneId, const unsigned int zoneType)
 {
 
+	evohome::device::zone *myZone = get_zone_by_ID(szZoneId);
+	if (myZone == NULL)
+		return false;
+
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, szZoneId, zoneType);
-	EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
+	if (myZone->jSchedule.isNull())
+		m_mValidators.erase(szUrl);
+
+	bool bModified;
+	conditional_get(szUrl, bModified);
+	if (!bModified)
+	{
+		myZone->tScheduleFetched = time(NULL);
+		return true;
+	}
 
 	if (!m_szResponse.find("\"id\""))
 		return false;
-	evohome::device::zone *myZone = get_zone_by_ID(szZoneId);
-	if (myZone == NULL)
-		return false;
 
+	myZone->jSchedule.clear();
 	if (evohome::parse_json_string(m_szResponse, myZone->jSchedule) < 0)
 	{
 		m_szLastError = evohome::messages::invalidResponse;
+		m_mValidators.erase(szUrl);
 		return false;
 	}
+	myZone->tScheduleFetched = time(NULL);
 	return true;
 }
 
@@ -748,12 +1657,33 @@ std::string EvohomeClient2::get_next_switchpoint(evohome::device::zone *zone, st
 }
 std::string EvohomeClient2::get_next_switchpoint(evohome::device::zone *zone, std::string &szCurrentSetpoint, const int force_weekday, const bool bLocaltime)
 {
+	apply_schedule_updates();
+	if (zone->jSchedule.isNull() && (force_weekday < 0) && m_scheduleCache.is_open())
+	{
+		time_t tNext;
+		if (m_scheduleCache.get_next_switchpoint(zone->szZoneId, time(NULL), tNext, szCurrentSetpoint))
+		{
+			int ttl = get_schedule_ttl(zone->szZoneId);
+			if ((ttl > 0) && (time(NULL) - m_scheduleCache.get_creation_time() >= ttl))
+				refresh_schedule_async(zone);
+
+			struct tm ntime;
+			localtime_r(&tNext, &ntime);
+			char cNext[30];
+			sprintf_s(cNext, 30, "%04d-%02d-%02dT%02d:%02d:%02dA", (ntime.tm_year&0xFFF) + 1900, (ntime.tm_mon&0xF) + 1, ntime.tm_mday&0x3F, ntime.tm_hour&0x3F, ntime.tm_min&0x3F, ntime.tm_sec&0x3F);
+			if (!bLocaltime)
+				return IsoTimeString::local_to_utc(std::string(cNext));
+			return std::string(cNext);
+		}
+	}
 	if (zone->jSchedule.isNull())
 	{
 		int zoneType = ((*zone->jInstallationInfo).isMember("dhwId")) ? 1 : 0;
 		if (!get_zone_schedule_ex(zone->szZoneId, zoneType))
 			return m_szEmptyFieldResponse;
 	}
+	else if (is_schedule_stale(zone))
+		refresh_schedule_async(zone);
 
 	Json::Value *jSchedule = &(zone->jSchedule);
 	int numSchedules = static_cast<int>((*jSchedule)["dailySchedules"].size());
@@ -920,7 +1850,7 @@ bool EvohomeClient2::schedules_backup(const std::string &szFilename)
 							continue;
 
 						std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, szZoneId, 0);
-						EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
+						EvoHTTPBridge::SafeGET(szUrl, get_auth_header(), m_szResponse, -1);
 
 						if (!m_szResponse.find("\"id\""))
 							continue;
@@ -936,10 +1866,10 @@ bool EvohomeClient2::schedules_backup(const std::string &szFilename)
 						jBackupScheduleZone["zoneId"] = szZoneId;
 						jBackupScheduleZone["name"] = (*jTCS)["zones"][iz]["name"].asString();
 						if (jDailySchedule["dailySchedules"].isArray())
-							jBackupScheduleZone["dailySchedules"] = jDailySchedule["dailySchedules"];
+							jBackupScheduleZone["dailySchedules"].swap(jDailySchedule["dailySchedules"]);
 						else
 							jBackupScheduleZone["dailySchedules"] = Json::arrayValue;
-						jBackupScheduleTCS[szZoneId] = jBackupScheduleZone;
+						jBackupScheduleTCS[szZoneId].swap(jBackupScheduleZone);
 					}
 
 					// Hot Water
@@ -950,7 +1880,7 @@ bool EvohomeClient2::schedules_backup(const std::string &szFilename)
 							continue;
 
 						std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, szHotWaterId, 1);
-						EvoHTTPBridge::SafeGET(szUrl, m_vEvoHeader, m_szResponse, -1);
+						EvoHTTPBridge::SafeGET(szUrl, get_auth_header(), m_szResponse, -1);
 
 						if ( ! m_szResponse.find("\"id\""))
 							return false;
@@ -965,19 +1895,22 @@ bool EvohomeClient2::schedules_backup(const std::string &szFilename)
 						Json::Value jBackupScheduleDHW;
 						jBackupScheduleDHW["dhwId"] = szHotWaterId;
 						if (jDailySchedule["dailySchedules"].isArray())
-							jBackupScheduleDHW["dailySchedules"] = jDailySchedule["dailySchedules"];
+							jBackupScheduleDHW["dailySchedules"].swap(jDailySchedule["dailySchedules"]);
 						else
 							jBackupScheduleDHW["dailySchedules"] = Json::arrayValue;
-						jBackupScheduleTCS[szHotWaterId] = jBackupScheduleDHW;
+						jBackupScheduleTCS[szHotWaterId].swap(jBackupScheduleDHW);
 					}
-					jBackupScheduleGateway[szTCSId] = jBackupScheduleTCS;
+					jBackupScheduleGateway[szTCSId].swap(jBackupScheduleTCS);
 				}
-				jBackupScheduleLocation[szGatewayId] = jBackupScheduleGateway;
+				jBackupScheduleLocation[szGatewayId].swap(jBackupScheduleGateway);
 			}
-			jBackupSchedule[szLocationId] = jBackupScheduleLocation;
+			jBackupSchedule[szLocationId].swap(jBackupScheduleLocation);
 		}
 
-		myfile << jBackupSchedule.toStyledString() << "\n";
+		std::string szBackup;
+		Json::BufferWriter("\t").write(jBackupSchedule, szBackup);
+		szBackup.append(1, '\n');
+		myfile.write(szBackup.c_str(), static_cast<std::streamsize>(szBackup.size()));
 		myfile.close();
 		return true;
 	}
@@ -989,6 +1922,37 @@ bool EvohomeClient2::schedules_backup(const std::string &szFilename)
  * Load all schedules from a schedule backup file
  */
 bool EvohomeClient2::load_schedules_from_file(const std::string &szFilename)
+{
+	Json::Value jSchedule;
+	if (!read_schedules_file(szFilename, jSchedule))
+		return false;
+
+	std::map<std::string, Json::Value*> mSchedules;
+	find_backup_schedules(jSchedule, mSchedules);
+
+	// schedules from file are as old as the file
+	time_t tFileTime = time(NULL);
+	struct stat fileStat;
+	if (stat(szFilename.c_str(), &fileStat) == 0)
+		tFileTime = fileStat.st_mtime;
+
+	std::map<std::string, Json::Value*>::iterator it;
+	for (it = mSchedules.begin(); it != mSchedules.end(); ++it)
+	{
+		evohome::device::zone *zone = get_zone_by_ID(it->first);
+		if (zone != NULL)
+		{
+			zone->jSchedule = *it->second;
+			zone->tScheduleFetched = tFileTime;
+			int zoneType = ((*zone->jInstallationInfo).isMember("dhwId")) ? 1 : 0;
+			m_mValidators.erase(evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, zone->szZoneId, zoneType));
+		}
+	}
+	return true;
+}
+
+
+/* private */ bool EvohomeClient2::read_schedules_file(const std::string &szFilename, Json::Value &jSchedules)
 {
 	std::string szFileContent;
 	std::ifstream myfile (szFilename.c_str());
@@ -1003,53 +1967,44 @@ bool EvohomeClient2::load_schedules_from_file(const std::string &szFilename)
 		myfile.close();
 	}
 
-	Json::Value jSchedule;
-
-	if (szFileContent.empty() || (evohome::parse_json_string(szFileContent, jSchedule) < 0))
+	if (szFileContent.empty() || (evohome::parse_json_string(szFileContent, jSchedules) < 0))
 	{
 		m_szLastError = "Failed to parse file content as JSON";
 		return false;
 	}
+	return true;
+}
 
-	Json::Value::Members locations = jSchedule.getMemberNames();
-	int numLocations = static_cast<int>(m_vLocations.size());
-	for (int il = 0; il < numLocations; il++)
+
+/*
+ * Collect the zone and hot water schedules in a backup, keyed by zoneId or dhwId
+ *
+ * The backup is organised as location -> gateway -> system -> zone, with string
+ * members for the names and IDs at every level.
+ */
+/* private */ void EvohomeClient2::find_backup_schedules(Json::Value &jSchedules, std::map<std::string, Json::Value*> &mSchedules)
+{
+	Json::Value::iterator itl, itgw, itcs, itz;
+	for (itl = jSchedules.begin(); itl != jSchedules.end(); ++itl)
 	{
-		if (jSchedule[locations[il]].isString())
+		if (!(*itl).isObject())
 			continue;
-		Json::Value::Members gateways = jSchedule[locations[il]].getMemberNames();
-
-		int numGateways = static_cast<int>(gateways.size());
-		for (int igw = 0; igw < numGateways; igw++)
+		for (itgw = (*itl).begin(); itgw != (*itl).end(); ++itgw)
 		{
-			if (jSchedule[locations[il]][gateways[igw]].isString())
+			if (!(*itgw).isObject())
 				continue;
-
-			Json::Value *jGateway = &jSchedule[locations[il]][gateways[igw]];
-			Json::Value::Members temperatureControlSystems = (*jGateway).getMemberNames();
-
-			int numTCS = static_cast<int>(temperatureControlSystems.size());
-			for (int itcs = 0; itcs < numTCS; itcs++)
+			for (itcs = (*itgw).begin(); itcs != (*itgw).end(); ++itcs)
 			{
-				if ((*jGateway)[temperatureControlSystems[itcs]].isString())
+				if (!(*itcs).isObject())
 					continue;
-
-				Json::Value *jTCS = &(*jGateway)[temperatureControlSystems[itcs]];
-				Json::Value::Members zones = (*jTCS).getMemberNames();
-
-				int numZones = static_cast<int>(zones.size());
-				for (int iz = 0; iz < numZones; iz++)
+				for (itz = (*itcs).begin(); itz != (*itcs).end(); ++itz)
 				{
-					if ((*jTCS)[zones[iz]].isString())
-						continue;
-					evohome::device::zone *zone = get_zone_by_ID(zones[iz]);
-					if (zone != NULL)
-						zone->jSchedule = (*jTCS)[zones[iz]];
+					if ((*itz).isObject())
+						mSchedules[itz.name()] = &(*itz);
 				}
 			}
 		}
 	}
-	return true;
 }
 
 
@@ -1066,35 +2021,28 @@ bool EvohomeClient2::set_dhw_schedule(const std::string szDHWId, Json::Value *jS
 }
 /* private */ bool EvohomeClient2::set_zone_schedule_ex(const std::string szZoneId, const unsigned int zoneType, Json::Value *jSchedule)
 {
-	std::string szPutdata = (*jSchedule).toStyledString();
-	int numChars = static_cast<int>(szPutdata.length());
-	for (int i = 0; i < numChars; i++)
+	ScheduleWriter::write(*jSchedule, m_szPutData);
+
+	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, szZoneId, zoneType);
+	m_mValidators.erase(szUrl);
+	bool bhttpOK = EvoHTTPBridge::SafePUT(szUrl, m_szPutData, get_auth_header(), m_szResponse, -1);
+	if (!bhttpOK || (m_szResponse.find("\"id\"") == std::string::npos))
 	{
-		char c = szPutdata[i];
-		if (c == '"')
-		{
-			i++;
-			c = szPutdata[i];
-			if ((c > 0x60) && (c < 0x7b))
-				szPutdata[i] = c ^ 0x20;
-		}
+		m_szLastError = evohome::messages::cmdRejected;
+		return false;
 	}
 
-	size_t insertAt = 0;
-	while ((insertAt = szPutdata.find("\"Temperature\"")) != std::string::npos)
+	// write through to the schedule cache, only once the portal accepted the schedule
+	evohome::device::zone *myZone = get_zone_by_ID(szZoneId);
+	if (myZone != NULL)
 	{
-		insertAt++;
-		szPutdata.insert(insertAt, "Target");
-		insertAt +=17;
+		if (&myZone->jSchedule != jSchedule)
+			myZone->jSchedule = *jSchedule;
+		myZone->jSchedule.removeMember("currentSetpoint");
+		myZone->jSchedule.removeMember("nextSwitchpoint");
+		myZone->tScheduleFetched = time(NULL);
 	}
-
-	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, szZoneId, zoneType);
-	EvoHTTPBridge::SafePUT(szUrl, szPutdata, m_vEvoHeader, m_szResponse, -1);
-
-	if (m_szResponse.find("\"id\""))
-		return true;
-	m_szLastError = evohome::messages::cmdRejected;
-	return false;
+	return true;
 }
 
 
@@ -1134,14 +2082,446 @@ bool EvohomeClient2::schedules_restore(const std::string &szFilename)
 				}
 				if (has_dhw(tcs))
 				{
-					std::string dhwId = (*(*tcs).jStatus)["dhw"]["dhwId"].asString();
+					std::string dhwId = (*tcs).dhw[0].szZoneId;
 					std::cout << "        Hot water\n";
 					set_dhw_schedule(dhwId, &(*tcs).dhw[0].jSchedule);
 				}
 			}
 		}
 	}
-	return true;
+	return true;
+}
+
+
+/*
+ * Restore only the schedules that differ from the controller
+ */
+bool EvohomeClient2::schedules_restore(const std::string &szFilename, std::vector<evohome::schedule::restore_item> &vReport, const bool bDryRun, const unsigned int maxConcurrent)
+{
+	vReport.clear();
+	Json::Value jBackup;
+	if (!read_schedules_file(szFilename, jBackup))
+		return false;
+
+	std::map<std::string, Json::Value*> mSchedules;
+	find_backup_schedules(jBackup, mSchedules);
+
+	std::vector<evohome::device::zone*> vZones;
+	std::vector<int> vZoneIdx;
+	std::map<std::string, Json::Value*>::iterator it;
+	for (it = mSchedules.begin(); it != mSchedules.end(); ++it)
+	{
+		evohome::schedule::restore_item item;
+		item.szZoneId = it->first;
+		item.szName = (*it->second)["name"].asString();
+		item.bDHW = (*it->second).isMember("dhwId");
+		item.bChanged = false;
+		item.bRestored = false;
+
+		evohome::device::zone *zone = get_zone_by_ID(it->first);
+		if (zone == NULL)
+		{
+			item.szError = evohome::messages::zoneNotFound;
+			vZoneIdx.push_back(-1);
+		}
+		else
+		{
+			vZoneIdx.push_back(static_cast<int>(vZones.size()));
+			vZones.push_back(zone);
+		}
+		vReport.push_back(item);
+	}
+
+	std::vector<bool> vFetched;
+	fetch_zone_schedules(vZones, maxConcurrent, vFetched);
+
+	bool bAllOK = true;
+	std::string szBackup, szCurrent;
+	for (size_t i = 0; i < vReport.size(); i++)
+	{
+		evohome::schedule::restore_item *item = &vReport[i];
+		if (!item->szError.empty())
+		{
+			bAllOK = false;
+			continue;
+		}
+
+		evohome::device::zone *zone = vZones[vZoneIdx[i]];
+		if (!vFetched[vZoneIdx[i]])
+		{
+			// the current schedule is unknown: neither report nor send a change
+			item->szError = evohome::messages::scheduleUnavailable;
+			bAllOK = false;
+			continue;
+		}
+
+		Json::Value *jBackupSchedule = mSchedules[item->szZoneId];
+		ScheduleWriter::write_canonical(*jBackupSchedule, szBackup);
+		ScheduleWriter::write_canonical(zone->jSchedule, szCurrent);
+		item->bChanged = (szBackup != szCurrent);
+		if (!item->bChanged || bDryRun)
+			continue;
+
+		int zoneType = ((*zone->jInstallationInfo).isMember("dhwId")) ? 1 : 0;
+		item->bRestored = set_zone_schedule_ex(zone->szZoneId, zoneType, jBackupSchedule);
+		if (item->bRestored)
+			item->szError.clear();
+		else
+		{
+			item->szError = m_szLastError;
+			bAllOK = false;
+		}
+	}
+	return bAllOK;
+}
+
+
+/*
+ * Retrieve the schedules of many zones concurrently
+ *
+ * Requests carry the validators of the loaded schedules, so that schedules that
+ * did not change on the portal are kept without transferring them again.
+ * vFetched tells for each zone whether the portal confirmed its schedule. A zone
+ * whose request failed keeps the schedule it had.
+ */
+/* private */ void EvohomeClient2::fetch_zone_schedules(const std::vector<evohome::device::zone*> &vZones, const unsigned int maxConcurrent, std::vector<bool> &vFetched)
+{
+	vFetched.assign(vZones.size(), false);
+	if (vZones.empty())
+		return;
+
+	std::vector<std::string> vAuthHeader = get_auth_header();
+	std::vector<evohome::schedule::fetch> vFetch(vZones.size());
+	for (size_t i = 0; i < vZones.size(); i++)
+	{
+		int zoneType = ((*vZones[i]->jInstallationInfo).isMember("dhwId")) ? 1 : 0;
+		vFetch[i].szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, vZones[i]->szZoneId, zoneType);
+		vFetch[i].vRequestHeader = vAuthHeader;
+		vFetch[i].bhttpOK = false;
+		if (vZones[i]->jSchedule.isNull())
+			m_mValidators.erase(vFetch[i].szUrl);
+		std::map<std::string, evohome::API::request::validator>::iterator it = m_mValidators.find(vFetch[i].szUrl);
+		if (it != m_mValidators.end())
+		{
+			if (!it->second.szETag.empty())
+				vFetch[i].vRequestHeader.push_back("If-None-Match: " + it->second.szETag);
+			if (!it->second.szLastModified.empty())
+				vFetch[i].vRequestHeader.push_back("If-Modified-Since: " + it->second.szLastModified);
+		}
+	}
+
+	std::atomic<size_t> nextEntry(0);
+	size_t numWorkers = (maxConcurrent > 0) ? maxConcurrent : 1;
+	if (numWorkers > vFetch.size())
+		numWorkers = vFetch.size();
+	std::vector<std::thread> vWorkers;
+	for (size_t i = 1; i < numWorkers; i++)
+		vWorkers.push_back(std::thread(&EvohomeClient2::send_schedule_requests, std::ref(vFetch), std::ref(nextEntry)));
+	send_schedule_requests(vFetch, nextEntry);
+	for (size_t i = 0; i < vWorkers.size(); i++)
+		vWorkers[i].join();
+
+	for (size_t i = 0; i < vFetch.size(); i++)
+	{
+		evohome::schedule::fetch *result = &vFetch[i];
+		evohome::device::zone *zone = vZones[i];
+		int httpStatus = EvoHTTPBridge::GetHTTPStatus(result->vHeaderData);
+		if ((httpStatus == 304) && (m_mValidators.find(result->szUrl) != m_mValidators.end()))
+		{
+			zone->tScheduleFetched = time(NULL);
+			vFetched[i] = true;
+			continue;
+		}
+
+		m_mValidators.erase(result->szUrl);
+		Json::Value jSchedule;
+		EvoHTTPBridge::TakeParsed(result->pSchedule, jSchedule);
+		if (!result->bhttpOK || !jSchedule.isMember("dailySchedules"))
+			continue;
+		zone->jSchedule.swap(jSchedule);
+		zone->tScheduleFetched = time(NULL);
+		vFetched[i] = true;
+
+		evohome::API::request::validator newValidator;
+		newValidator.szETag = EvoHTTPBridge::GetHeaderValue(result->vHeaderData, "ETag");
+		newValidator.szLastModified = EvoHTTPBridge::GetHeaderValue(result->vHeaderData, "Last-Modified");
+		if (!newValidator.szETag.empty() || !newValidator.szLastModified.empty())
+			m_mValidators[result->szUrl] = newValidator;
+	}
+}
+
+
+/* private */ void EvohomeClient2::send_schedule_requests(std::vector<evohome::schedule::fetch> &vFetch, std::atomic<size_t> &nextEntry)
+{
+	size_t i;
+	while ((i = nextEntry++) < vFetch.size())
+		vFetch[i].bhttpOK = EvoHTTPBridge::SafeGET(vFetch[i].szUrl, vFetch[i].vRequestHeader, vFetch[i].szResponse, vFetch[i].vHeaderData, vFetch[i].pSchedule, -1);
+}
+
+
+/*
+ * Write the loaded schedules to a binary cache file
+ */
+bool EvohomeClient2::save_schedule_cache(const std::string &szFilename)
+{
+	apply_schedule_updates();
+	std::vector<evohome::schedule::cache::zone> vCacheZones;
+	for (size_t i = 0; i < m_vZonePaths.size(); i++)
+	{
+		evohome::device::zone *zone = get_zone_by_ID(m_vZonePaths[i].szZoneId);
+		if ((zone == NULL) || zone->jSchedule.isNull())
+			continue;
+		vCacheZones.push_back(evohome::schedule::cache::zone());
+		evohome::schedule::cache::zone *cacheZone = &vCacheZones.back();
+		cacheZone->szZoneId = zone->szZoneId;
+		cacheZone->bDHW = (*zone->jInstallationInfo).isMember("dhwId");
+		if (!compile_schedule(zone->jSchedule, *cacheZone))
+			vCacheZones.pop_back();
+	}
+	if (vCacheZones.empty())
+		return false;
+	return ScheduleCache::write(szFilename, vCacheZones);
+}
+
+
+bool EvohomeClient2::load_schedule_cache(const std::string &szFilename)
+{
+	return m_scheduleCache.open(szFilename);
+}
+
+
+/*
+ * Convert a schedule to switchpoint tables, sorted by time within every weekday
+ */
+/* private */ bool EvohomeClient2::compile_schedule(const Json::Value &jSchedule, evohome::schedule::cache::zone &cacheZone)
+{
+	if (!jSchedule["dailySchedules"].isArray())
+		return false;
+
+	int numSchedules = static_cast<int>(jSchedule["dailySchedules"].size());
+	for (int i = 0; i < numSchedules; i++)
+	{
+		const Json::Value &jDaySchedule = jSchedule["dailySchedules"][i];
+		int day = 0;
+		while ((day < 7) && (jDaySchedule["dayOfWeek"] != evohome::schedule::dayOfWeek[day]))
+			day++;
+		if (day == 7)
+			continue;
+
+		int numSwitchpoints = static_cast<int>(jDaySchedule["switchpoints"].size());
+		for (int j = 0; j < numSwitchpoints; j++)
+		{
+			const Json::Value &jSwitchpoint = jDaySchedule["switchpoints"][j];
+			std::string szTime = jSwitchpoint["timeOfDay"].asString();
+			if (szTime.length() < 5)
+				continue;
+			evohome::schedule::cache::switchpoint newSwitchpoint;
+			newSwitchpoint.secondOfDay = static_cast<uint32_t>(std::atoi(szTime.substr(0, 2).c_str()) * 3600 + std::atoi(szTime.substr(3, 2).c_str()) * 60);
+			if (szTime.length() >= 8)
+				newSwitchpoint.secondOfDay += static_cast<uint32_t>(std::atoi(szTime.substr(6, 2).c_str()));
+			if (jSwitchpoint.isMember("heatSetpoint"))
+				newSwitchpoint.value = static_cast<int32_t>(jSwitchpoint["heatSetpoint"].asDouble() * 100 + 0.5);
+			else
+				newSwitchpoint.value = (jSwitchpoint["dhwState"].asString() == evohome::API2::dhw::state[1]) ? 1 : 0;
+			cacheZone.vDays[day].push_back(newSwitchpoint);
+		}
+		std::sort(cacheZone.vDays[day].begin(), cacheZone.vDays[day].end(),
+			[](const evohome::schedule::cache::switchpoint &a, const evohome::schedule::cache::switchpoint &b) { return a.secondOfDay < b.secondOfDay; });
+	}
+	return true;
+}
+
+
+/*
+ * Schedule cache TTL in seconds for all zones, 0 disables expiry
+ */
+void EvohomeClient2::set_schedule_cache_ttl(const int seconds)
+{
+	m_iScheduleTTL = (seconds > 0) ? seconds : 0;
+}
+
+
+/*
+ * Schedule cache TTL in seconds for a single zone, a negative value restores the default
+ */
+void EvohomeClient2::set_schedule_cache_ttl(const std::string szZoneId, const int seconds)
+{
+	if (seconds < 0)
+		m_mScheduleTTL.erase(szZoneId);
+	else
+		m_mScheduleTTL[szZoneId] = seconds;
+}
+
+
+/* private */ int EvohomeClient2::get_schedule_ttl(const std::string &szZoneId)
+{
+	std::map<std::string, int>::iterator it = m_mScheduleTTL.find(szZoneId);
+	if (it != m_mScheduleTTL.end())
+		return it->second;
+	return m_iScheduleTTL;
+}
+
+
+/* private */ bool EvohomeClient2::is_schedule_stale(const evohome::device::zone *zone)
+{
+	int ttl = get_schedule_ttl(zone->szZoneId);
+	if (ttl == 0)
+		return false;
+	return (time(NULL) - zone->tScheduleFetched >= ttl);
+}
+
+
+/*
+ * Queue a zone's schedule for retrieval by the schedule refresh thread
+ *
+ * The refresh thread does not touch the installation structs. Its results are
+ * applied by apply_schedule_updates() from the thread that uses the client.
+ */
+/* private */ void EvohomeClient2::refresh_schedule_async(evohome::device::zone *zone)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxScheduleRefresh);
+		if (m_sScheduleRefreshIds.find(zone->szZoneId) != m_sScheduleRefreshIds.end())
+			return; // already queued
+	}
+
+	evohome::schedule::refresh request;
+	int zoneType = ((*zone->jInstallationInfo).isMember("dhwId")) ? 1 : 0;
+	request.szZoneId = zone->szZoneId;
+	request.szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSchedule, zone->szZoneId, zoneType);
+	request.vRequestHeader = get_auth_header();
+	request.tRequested = time(NULL);
+	request.bNotModified = false;
+	request.bSuccess = false;
+	std::map<std::string, evohome::API::request::validator>::iterator it = m_mValidators.find(request.szUrl);
+	if (it != m_mValidators.end())
+	{
+		if (!it->second.szETag.empty())
+			request.vRequestHeader.push_back("If-None-Match: " + it->second.szETag);
+		if (!it->second.szLastModified.empty())
+			request.vRequestHeader.push_back("If-Modified-Since: " + it->second.szLastModified);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mtxScheduleRefresh);
+		m_sScheduleRefreshIds.insert(request.szZoneId);
+		m_lScheduleRequests.push_back(evohome::schedule::refresh());
+		std::swap(m_lScheduleRequests.back(), request);
+		if (!m_tScheduleRefresh.joinable())
+		{
+			m_bScheduleRefreshStop = false;
+			m_tScheduleRefresh = std::thread(&EvohomeClient2::process_schedule_refresh, this);
+		}
+	}
+	m_cvScheduleRefresh.notify_all();
+}
+
+
+/*
+ * Move schedules retrieved by the refresh thread into the zone structs
+ *
+ * A result is dropped if the zone's schedule was replaced after the request was
+ * queued, for instance by set_zone_schedule().
+ */
+/* private */ void EvohomeClient2::apply_schedule_updates()
+{
+	std::list<evohome::schedule::refresh> lResults;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxScheduleRefresh);
+		if (m_lScheduleResults.empty())
+			return;
+		lResults.swap(m_lScheduleResults);
+		std::list<evohome::schedule::refresh>::iterator it;
+		for (it = lResults.begin(); it != lResults.end(); ++it)
+			m_sScheduleRefreshIds.erase(it->szZoneId);
+	}
+
+	std::list<evohome::schedule::refresh>::iterator it;
+	for (it = lResults.begin(); it != lResults.end(); ++it)
+	{
+		evohome::device::zone *zone = get_zone_by_ID(it->szZoneId);
+		if ((zone == NULL) || (zone->tScheduleFetched > it->tRequested))
+			continue;
+		if (!it->bSuccess)
+		{
+			// keep the stale schedule and try again after a short delay
+			time_t tRetry = it->tRequested - get_schedule_ttl(it->szZoneId) + SCHEDULE_REFRESH_RETRY_DELAY;
+			if (zone->tScheduleFetched < tRetry)
+				zone->tScheduleFetched = tRetry;
+			continue;
+		}
+		zone->tScheduleFetched = it->tRequested;
+		if (it->bNotModified && !zone->jSchedule.isNull())
+			continue;
+
+		zone->jSchedule.swap(it->jSchedule);
+		evohome::API::request::validator newValidator;
+		newValidator.szETag = it->szETag;
+		newValidator.szLastModified = it->szLastModified;
+		if (!newValidator.szETag.empty() || !newValidator.szLastModified.empty())
+			m_mValidators[it->szUrl] = newValidator;
+		else
+			m_mValidators.erase(it->szUrl);
+	}
+}
+
+
+/*
+ * Schedule refresh thread
+ */
+/* private */ void EvohomeClient2::process_schedule_refresh()
+{
+	std::unique_lock<std::mutex> lock(m_mtxScheduleRefresh);
+	while (!m_bScheduleRefreshStop)
+	{
+		if (m_lScheduleRequests.empty())
+		{
+			m_cvScheduleRefresh.wait(lock);
+			continue;
+		}
+
+		evohome::schedule::refresh request;
+		std::swap(request, m_lScheduleRequests.front());
+		m_lScheduleRequests.pop_front();
+		lock.unlock();
+
+		std::string szResponse;
+		std::vector<std::string> vHeaderData;
+		std::shared_ptr<const Json::Value> pSchedule;
+		bool bhttpOK = EvoHTTPBridge::SafeGET(request.szUrl, request.vRequestHeader, szResponse, vHeaderData, pSchedule, -1);
+		if (EvoHTTPBridge::GetHTTPStatus(vHeaderData) == 304)
+		{
+			request.bNotModified = true;
+			request.bSuccess = true;
+		}
+		else if (bhttpOK)
+		{
+			EvoHTTPBridge::TakeParsed(pSchedule, request.jSchedule);
+			if (request.jSchedule.isMember("dailySchedules"))
+			{
+				request.bSuccess = true;
+				request.szETag = EvoHTTPBridge::GetHeaderValue(vHeaderData, "ETag");
+				request.szLastModified = EvoHTTPBridge::GetHeaderValue(vHeaderData, "Last-Modified");
+			}
+		}
+
+		lock.lock();
+		m_lScheduleResults.push_back(evohome::schedule::refresh());
+		std::swap(m_lScheduleResults.back(), request);
+	}
+}
+
+
+/* private */ void EvohomeClient2::stop_schedule_refresh()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxScheduleRefresh);
+		if (!m_tScheduleRefresh.joinable())
+			return;
+		m_bScheduleRefreshStop = true;
+	}
+	m_cvScheduleRefresh.notify_all();
+	m_tScheduleRefresh.join();
 }
 
 
@@ -1170,31 +2550,14 @@ bool EvohomeClient2::set_system_mode(const std::string szSystemId, const std::st
 }
 bool EvohomeClient2::set_system_mode(const std::string szSystemId, const unsigned int mode, const std::string szDateUntil)
 {
-	std::string szPutData = "{\"SystemMode\":\"";
-	szPutData.append(evohome::API2::system::mode[mode]);
-	szPutData.append("\",\"TimeUntil\":");
-	if (szDateUntil.empty())
-		szPutData.append("null");
-	else if (!IsoTimeString::verify_date(szDateUntil))
+	if (!build_system_mode_body(m_szPutData, mode, szDateUntil))
 	{
 		m_szLastError = evohome::messages::invalidTimestamp;
 		return false;
 	}
-	else
-	{
-		std::string szTimeUntil = szDateUntil + "T00:00:00";
-		szPutData.append("\"");
-		szPutData.append(IsoTimeString::local_to_utc(szTimeUntil));
-		szPutData.append("\"");
-	}
-	szPutData.append(",\"Permanent\":");
-	if (szDateUntil.empty())
-		szPutData.append("true}");
-	else
-		szPutData.append("false}");
 
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::systemMode, szSystemId);
-	EvoHTTPBridge::SafePUT(szUrl, szPutData, m_vEvoHeader, m_szResponse, -1);
+	EvoHTTPBridge::SafePUT(szUrl, m_szPutData, get_auth_header(), m_szResponse, -1);
 
 	if (m_szResponse.find("\"id\""))
 		return true;
@@ -1203,37 +2566,44 @@ bool EvohomeClient2::set_system_mode(const std::string szSystemId, const unsigne
 }
 
 
+/*
+ * Write the systemMode body into szPutData, returns false if szDateUntil is not a valid date
+ */
+/* private */ bool EvohomeClient2::build_system_mode_body(std::string &szPutData, const unsigned int mode, const std::string &szDateUntil)
+{
+	szPutData.clear();
+	szPutData.append("{\"SystemMode\":\"");
+	szPutData.append(evohome::API2::system::mode[mode]);
+	szPutData.append("\",\"TimeUntil\":");
+	if (szDateUntil.empty())
+	{
+		szPutData.append("null,\"Permanent\":true}");
+		return true;
+	}
+	if (!IsoTimeString::verify_date(szDateUntil))
+		return false;
+
+	std::string szTimeUntil = szDateUntil + "T00:00:00";
+	szPutData.append("\"");
+	szPutData.append(IsoTimeString::local_to_utc(szTimeUntil));
+	szPutData.append("\",\"Permanent\":false}");
+	return true;
+}
+
+
 /*
  * Override a zone's target temperature
  */
 bool EvohomeClient2::set_temperature(const std::string szZoneId, const std::string temperature, const std::string szTimeUntil)
 {
-	std::string szPutData = "{\"HeatSetpointValue\":";
-	szPutData.append(temperature);
-	szPutData.append(",\"SetpointMode\":\"");
-	if (szTimeUntil.empty())
-		szPutData.append(evohome::API2::zone::mode[1]);
-	else if (!IsoTimeString::verify_datetime(szTimeUntil))
+	if (!build_setpoint_body(m_szPutData, temperature, szTimeUntil))
 	{
 		m_szLastError = evohome::messages::invalidTimestamp;
 		return false;
 	}
-	else
-		szPutData.append(evohome::API2::zone::mode[2]);
-	szPutData.append("\",\"TimeUntil\":");
-	if (szTimeUntil.empty())
-		szPutData.append("null}");
-	else
-	{
-		szPutData.append("\"");
-		szPutData.append(szTimeUntil.substr(0,10));
-		szPutData.append("T");
-		szPutData.append(szTimeUntil.substr(11,8));
-		szPutData.append("Z\"}");
-	}
 
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSetpoint, szZoneId);
-	EvoHTTPBridge::SafePUT(szUrl, szPutData, m_vEvoHeader, m_szResponse, -1);
+	EvoHTTPBridge::SafePUT(szUrl, m_szPutData, get_auth_header(), m_szResponse, -1);
 
 	if (m_szResponse.find("\"id\""))
 		return true;
@@ -1242,15 +2612,116 @@ bool EvohomeClient2::set_temperature(const std::string szZoneId, const std::stri
 }
 
 
+/*
+ * Write the heatSetpoint body into szPutData, reusing its allocated buffer
+ *
+ * An empty setpoint produces the body that cancels the override. Returns false
+ * if szTimeUntil is not a valid timestamp.
+ */
+/* private */ bool EvohomeClient2::build_setpoint_body(std::string &szPutData, const std::string &szSetpoint, const std::string &szTimeUntil)
+{
+	szPutData.clear();
+	if (szSetpoint.empty())
+	{
+		szPutData.append("{\"HeatSetpointValue\":0.0,\"SetpointMode\":\"FollowSchedule\",\"TimeUntil\":null}");
+		return true;
+	}
+	if (!szTimeUntil.empty() && !IsoTimeString::verify_datetime(szTimeUntil))
+		return false;
+
+	szPutData.append("{\"HeatSetpointValue\":");
+	szPutData.append(szSetpoint);
+	szPutData.append(",\"SetpointMode\":\"");
+	if (szTimeUntil.empty())
+	{
+		szPutData.append(evohome::API2::zone::mode[1]);
+		szPutData.append("\",\"TimeUntil\":null}");
+		return true;
+	}
+	szPutData.append(evohome::API2::zone::mode[2]);
+	szPutData.append("\",\"TimeUntil\":\"");
+	szPutData.append(szTimeUntil, 0, 10);
+	szPutData.append("T");
+	szPutData.append(szTimeUntil, 11, 8);
+	szPutData.append("Z\"}");
+	return true;
+}
+
+
+/*
+ * Set target temperatures for many zones concurrently
+ */
+bool EvohomeClient2::set_temperatures(std::vector<evohome::command::setpoint> &vSetpoints, const unsigned int maxConcurrent)
+{
+	if (vSetpoints.empty())
+		return true;
+
+	std::vector<std::string> vRequestHeader = get_auth_header();
+	std::atomic<size_t> nextEntry(0);
+
+	size_t numWorkers = (maxConcurrent > 0) ? maxConcurrent : 1;
+	if (numWorkers > vSetpoints.size())
+		numWorkers = vSetpoints.size();
+
+	// the calling thread is one of the workers
+	std::vector<std::thread> vWorkers;
+	for (size_t i = 1; i < numWorkers; i++)
+		vWorkers.push_back(std::thread(&EvohomeClient2::send_setpoints, this, std::ref(vSetpoints), std::ref(nextEntry), std::cref(vRequestHeader)));
+	send_setpoints(vSetpoints, nextEntry, vRequestHeader);
+	for (size_t i = 0; i < vWorkers.size(); i++)
+		vWorkers[i].join();
+
+	bool bAllOK = true;
+	for (size_t i = 0; i < vSetpoints.size(); i++)
+	{
+		if (!vSetpoints[i].bSuccess)
+		{
+			m_szLastError = vSetpoints[i].szError;
+			bAllOK = false;
+		}
+	}
+	return bAllOK;
+}
+
+
+/*
+ * Worker for set_temperatures(), takes entries from the list until none are left
+ */
+/* private */ void EvohomeClient2::send_setpoints(std::vector<evohome::command::setpoint> &vSetpoints, std::atomic<size_t> &nextEntry, const std::vector<std::string> &vRequestHeader)
+{
+	std::string szPutData;
+	std::string szResponse;
+	size_t i;
+	while ((i = nextEntry++) < vSetpoints.size())
+	{
+		evohome::command::setpoint *pSetpoint = &vSetpoints[i];
+		pSetpoint->bSuccess = false;
+		pSetpoint->szError.clear();
+		if (!build_setpoint_body(szPutData, pSetpoint->szSetpoint, pSetpoint->szTimeUntil))
+		{
+			pSetpoint->szError = evohome::messages::invalidTimestamp;
+			continue;
+		}
+
+		std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSetpoint, pSetpoint->szZoneId);
+		bool bhttpOK = EvoHTTPBridge::SafePUT(szUrl, szPutData, vRequestHeader, szResponse, -1);
+		if (bhttpOK && (szResponse.find("\"id\"") != std::string::npos))
+			pSetpoint->bSuccess = true;
+		else
+			pSetpoint->szError = evohome::messages::cmdRejected;
+	}
+}
+
+
 /*
  * Cancel a zone's target temperature override
  */
 bool EvohomeClient2::cancel_temperature_override(const std::string szZoneId)
 {
-	std::string szPutData = "{\"HeatSetpointValue\":0.0,\"SetpointMode\":\"FollowSchedule\",\"TimeUntil\":null}";
+	build_setpoint_body(m_szPutData, "", "");
 
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSetpoint, szZoneId);
-	EvoHTTPBridge::SafePUT(szUrl, szPutData, m_vEvoHeader, m_szResponse, -1);
+	EvoHTTPBridge::SafePUT(szUrl, m_szPutData, get_auth_header(), m_szResponse, -1);
 
 	if (m_szResponse.find("\"id\""))
 		return true;
@@ -1292,7 +2763,29 @@ bool EvohomeClient2::is_single_heating_system()
  */
 bool EvohomeClient2::set_dhw_mode(const std::string szDHWId, const std::string szMode, const  std::string szTimeUntil)
 {
-	std::string szPutData = "{\"State\":\"";
+	if (!build_dhw_mode_body(m_szPutData, szMode, szTimeUntil))
+	{
+		m_szLastError = evohome::messages::invalidTimestamp;
+		return false;
+	}
+
+	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::dhwState, szDHWId);
+	EvoHTTPBridge::SafePUT(szUrl, m_szPutData, get_auth_header(), m_szResponse, -1);
+
+	if (m_szResponse.find("\"id\""))
+		return true;
+	m_szLastError = evohome::messages::cmdRejected;
+	return false;
+}
+
+
+/*
+ * Write the dhwState body into szPutData, returns false if szTimeUntil is not a valid timestamp
+ */
+/* private */ bool EvohomeClient2::build_dhw_mode_body(std::string &szPutData, const std::string &szMode, const std::string &szTimeUntil)
+{
+	szPutData.clear();
+	szPutData.append("{\"State\":\"");
 	if (szMode == "on")
 		szPutData.append(evohome::API2::dhw::state[1]);
 	else if (szMode == "off")
@@ -1303,37 +2796,213 @@ bool EvohomeClient2::set_dhw_mode(const std::string szDHWId, const std::string s
 	else if (szTimeUntil.empty())
 		szPutData.append(evohome::API2::zone::mode[1]);
 	else if (!IsoTimeString::verify_datetime(szTimeUntil))
-	{
-		m_szLastError = evohome::messages::invalidTimestamp;
 		return false;
-	}
 	else
 		szPutData.append(evohome::API2::zone::mode[2]);
 	szPutData.append("\",\"UntilTime\":");
 	if (szTimeUntil.empty())
+	{
 		szPutData.append("null}");
-	else
+		return true;
+	}
+	szPutData.append("\"");
+	szPutData.append(szTimeUntil, 0, 10);
+	szPutData.append("T");
+	szPutData.append(szTimeUntil, 11, 8);
+	szPutData.append("Z\"}");
+	return true;
+}
+
+
+bool EvohomeClient2::cancel_dhw_override(const std::string szDHWId)
+{
+	return set_dhw_mode(szDHWId, "auto");
+}
+
+
+/************************************************************************
+ *									*
+ *	Evohome command queue						*
+ *									*
+ ************************************************************************/
+
+bool EvohomeClient2::queue_temperature(const std::string szZoneId, const std::string temperature, const std::string szTimeUntil, evohome::command::completion fCompletion)
+{
+	std::string szPutData;
+	if (!build_setpoint_body(szPutData, temperature, szTimeUntil))
 	{
-		szPutData.append("\"");
-		szPutData.append(szTimeUntil.substr(0,10));
-		szPutData.append("T");
-		szPutData.append(szTimeUntil.substr(11,8));
-		szPutData.append("Z\"}");
+		m_szLastError = evohome::messages::invalidTimestamp;
+		return false;
 	}
+	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::zoneSetpoint, szZoneId);
+	enqueue_command(evohome::command::type::zoneSetpoint, szZoneId, szUrl, szPutData, fCompletion);
+	return true;
+}
 
+
+bool EvohomeClient2::queue_dhw_mode(const std::string szDHWId, const std::string szMode, const std::string szTimeUntil, evohome::command::completion fCompletion)
+{
+	std::string szPutData;
+	if (!build_dhw_mode_body(szPutData, szMode, szTimeUntil))
+	{
+		m_szLastError = evohome::messages::invalidTimestamp;
+		return false;
+	}
 	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::dhwState, szDHWId);
-	EvoHTTPBridge::SafePUT(szUrl, szPutData, m_vEvoHeader, m_szResponse, -1);
+	enqueue_command(evohome::command::type::dhwMode, szDHWId, szUrl, szPutData, fCompletion);
+	return true;
+}
 
-	if (m_szResponse.find("\"id\""))
-		return true;
-	m_szLastError = evohome::messages::cmdRejected;
-	return false;
+
+bool EvohomeClient2::queue_system_mode(const std::string szSystemId, const unsigned int mode, const std::string szDateUntil, evohome::command::completion fCompletion)
+{
+	std::string szPutData;
+	if (!build_system_mode_body(szPutData, mode, szDateUntil))
+	{
+		m_szLastError = evohome::messages::invalidTimestamp;
+		return false;
+	}
+	std::string szUrl = evohome::API2::uri::get_uri(evohome::API2::uri::systemMode, szSystemId);
+	enqueue_command(evohome::command::type::systemMode, szSystemId, szUrl, szPutData, fCompletion);
+	return true;
 }
 
 
-bool EvohomeClient2::cancel_dhw_override(const std::string szDHWId)
+void EvohomeClient2::set_command_queue_delay(const int milliseconds)
 {
-	return set_dhw_mode(szDHWId, "auto");
+	{
+		std::lock_guard<std::mutex> lock(m_mtxCommandQueue);
+		m_iCommandQueueDelay = (milliseconds > 0) ? milliseconds : 0;
+	}
+	m_cvCommandQueue.notify_all();
+}
+
+
+/*
+ * Block until all queued commands have been sent
+ */
+void EvohomeClient2::wait_for_command_queue()
+{
+	std::unique_lock<std::mutex> lock(m_mtxCommandQueue);
+	m_cvCommandQueue.wait(lock, [this]{ return (m_lCommandQueue.empty() && !m_bCommandInFlight); });
+}
+
+
+/*
+ * Add a command to the queue, replacing a waiting command for the same target
+ */
+/* private */ void EvohomeClient2::enqueue_command(const evohome::command::type::value eType, const std::string &szTargetId, const std::string &szUrl, const std::string &szPutData, evohome::command::completion fCompletion)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxCommandQueue);
+		std::list<evohome::command::queued>::iterator it;
+		for (it = m_lCommandQueue.begin(); it != m_lCommandQueue.end(); ++it)
+		{
+			if ((it->eType == eType) && (it->szTargetId == szTargetId))
+				break;
+		}
+		if (it == m_lCommandQueue.end())
+		{
+			m_lCommandQueue.push_back(evohome::command::queued());
+			it = --m_lCommandQueue.end();
+			it->eType = eType;
+			it->szTargetId = szTargetId;
+		}
+		it->szUrl = szUrl;
+		it->szPutData = szPutData;
+		it->tUpdated = std::chrono::steady_clock::now();
+		if (fCompletion)
+			it->vCompletions.push_back(fCompletion);
+		else
+			it->vCompletions.push_back(evohome::command::completion());
+
+		if (!m_tCommandQueue.joinable())
+		{
+			m_bCommandQueueStop = false;
+			m_tCommandQueue = std::thread(&EvohomeClient2::process_command_queue, this);
+		}
+	}
+	m_cvCommandQueue.notify_all();
+}
+
+
+/*
+ * Command queue thread
+ *
+ * Only the queue, the auth header and local buffers are used here, so that the
+ * thread does not interfere with calls that the application makes on the client.
+ */
+/* private */ void EvohomeClient2::process_command_queue()
+{
+	std::string szResponse;
+	std::unique_lock<std::mutex> lock(m_mtxCommandQueue);
+	while (true)
+	{
+		if (m_lCommandQueue.empty())
+		{
+			if (m_bCommandQueueStop)
+				break;
+			m_cvCommandQueue.wait(lock);
+			continue;
+		}
+
+		// hold the command until no replacement has arrived for the queue delay
+		std::chrono::steady_clock::time_point tSend = m_lCommandQueue.front().tUpdated + std::chrono::milliseconds(m_iCommandQueueDelay);
+		if (!m_bCommandQueueStop && (std::chrono::steady_clock::now() < tSend))
+		{
+			m_cvCommandQueue.wait_until(lock, tSend);
+			continue;
+		}
+
+		evohome::command::queued command;
+		std::swap(command, m_lCommandQueue.front());
+		m_lCommandQueue.pop_front();
+		m_bCommandInFlight = true;
+		lock.unlock();
+
+		std::vector<std::string> vRequestHeader;
+		{
+			std::lock_guard<std::mutex> authlock(m_mtxAuthHeader);
+			vRequestHeader = m_vEvoHeader;
+		}
+		bool bhttpOK = EvoHTTPBridge::SafePUT(command.szUrl, command.szPutData, vRequestHeader, szResponse, -1);
+
+		evohome::command::result cmdResult;
+		cmdResult.eType = command.eType;
+		cmdResult.szTargetId = command.szTargetId;
+		cmdResult.bSuccess = (bhttpOK && (szResponse.find("\"id\"") != std::string::npos));
+		if (!cmdResult.bSuccess)
+			cmdResult.szError = evohome::messages::cmdRejected;
+		size_t n = command.vCompletions.size();
+		for (size_t i = 0; i < n; i++)
+		{
+			if (!command.vCompletions[i])
+				continue;
+			cmdResult.bSuperseded = (i + 1 < n);
+			command.vCompletions[i](cmdResult);
+		}
+
+		lock.lock();
+		m_bCommandInFlight = false;
+		m_cvCommandQueue.notify_all();
+	}
+}
+
+
+/*
+ * Send the remaining commands and stop the queue thread
+ */
+/* private */ void EvohomeClient2::stop_command_queue()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxCommandQueue);
+		if (!m_tCommandQueue.joinable())
+			return;
+		m_bCommandQueueStop = true;
+	}
+	m_cvCommandQueue.notify_all();
+	m_tCommandQueue.join();
+	m_cvCommandQueue.notify_all();
 }
 
 
@@ -1358,8 +3027,14 @@ std::string EvohomeClient2::get_zone_temperature(const std::string szZoneId)
 }
 std::string EvohomeClient2::get_zone_temperature(const evohome::device::zone *zone)
 {
-	Json::Value *jZoneStatus = (*zone).jStatus;
-	return (*jZoneStatus)["temperatureStatus"]["temperature"].asString();
+	if ((*zone).jStatus == NULL)
+	{
+		if (!(*zone).status.bTemperatureAvailable)
+			return m_szEmptyFieldResponse;
+		return Json::valueToString((*zone).status.dTemperature);
+	}
+	const Json::Value *jTemperature = get_status_field(zone, 0);
+	return (jTemperature == NULL) ? m_szEmptyFieldResponse : (*jTemperature).asString();
 }
 
 
@@ -1373,8 +3048,16 @@ std::string EvohomeClient2::get_zone_setpoint(const std::string szZoneId)
 }
 std::string EvohomeClient2::get_zone_setpoint(const evohome::device::zone *zone)
 {
-	Json::Value *jZoneStatus = (*zone).jStatus;
-	return (*jZoneStatus)["setpointStatus"]["targetHeatTemperature"].asString();
+	if ((*zone).jStatus == NULL)
+	{
+		if (!(*zone).status.bValid || ((*zone).zoneIdx & 128))
+			return m_szEmptyFieldResponse;
+		return Json::valueToString((*zone).status.dSetpoint);
+	}
+	if ((*zone).zoneIdx & 128)
+		return m_szEmptyFieldResponse;
+	const Json::Value *jSetpoint = get_status_field(zone, 1);
+	return (jSetpoint == NULL) ? m_szEmptyFieldResponse : (*jSetpoint).asString();
 }
 
 
@@ -1388,8 +3071,14 @@ std::string EvohomeClient2::get_zone_mode(const std::string szZoneId)
 }
 std::string EvohomeClient2::get_zone_mode(const evohome::device::zone *zone)
 {
-	Json::Value *jZoneStatus = (*zone).jStatus;
-	return (*jZoneStatus)["setpointStatus"]["setpointMode"].asString();
+	if ((*zone).jStatus == NULL)
+	{
+		if (!(*zone).status.bValid || ((*zone).status.mode < 0))
+			return m_szEmptyFieldResponse;
+		return evohome::API2::zone::mode[(*zone).status.mode];
+	}
+	const Json::Value *jMode = get_status_field(zone, 2);
+	return (jMode == NULL) ? m_szEmptyFieldResponse : (*jMode).asString();
 }
 
 
@@ -1403,10 +3092,15 @@ std::string EvohomeClient2::get_zone_mode_until(const std::string szZoneId, cons
 }
 std::string EvohomeClient2::get_zone_mode_until(const evohome::device::zone *zone, const bool bLocaltime)
 {
-	Json::Value *jZoneSetpoint = &(*zone->jStatus)["setpointStatus"];
 	std::string szResult;
-	if ((*jZoneSetpoint).isMember("until"))
-		szResult = (*jZoneSetpoint)["until"].asString();
+	if (zone->jStatus == NULL)
+		szResult = format_until(zone->status.tUntil);
+	else
+	{
+		const Json::Value *jUntil = get_status_field(zone, 3);
+		if (jUntil != NULL)
+			szResult = (*jUntil).asString();
+	}
 	if (szResult.size() < 10)
 		return m_szEmptyFieldResponse;
 	if (!bLocaltime)
@@ -1458,8 +3152,14 @@ std::string EvohomeClient2::get_system_mode(const std::string szSystemId)
 }
 std::string EvohomeClient2::get_system_mode(const evohome::device::temperatureControlSystem *tcs)
 {
-	Json::Value *jSystemMode = &(*tcs->jStatus)["systemModeStatus"];
-	return (*jSystemMode)["mode"].asString();
+	if (tcs->jStatus == NULL)
+	{
+		if (!tcs->status.bValid || (tcs->status.mode < 0))
+			return m_szEmptyFieldResponse;
+		return evohome::API2::system::mode[tcs->status.mode];
+	}
+	const Json::Value *jMode = get_status_field(tcs, 0);
+	return (jMode == NULL) ? m_szEmptyFieldResponse : (*jMode).asString();
 }
 
 
@@ -1473,10 +3173,15 @@ std::string EvohomeClient2::get_system_mode_until(const std::string szSystemId,
 }
 std::string EvohomeClient2::get_system_mode_until(const evohome::device::temperatureControlSystem *tcs, const bool bLocaltime)
 {
-	Json::Value *jSystemMode = &(*tcs->jStatus)["systemModeStatus"];
 	std::string szResult;
-	if ((*jSystemMode).isMember("timeUntil"))
-		szResult = (*jSystemMode)["timeUntil"].asString();
+	if (tcs->jStatus == NULL)
+		szResult = format_until(tcs->status.tUntil);
+	else
+	{
+		const Json::Value *jUntil = get_status_field(tcs, 1);
+		if (jUntil != NULL)
+			szResult = (*jUntil).asString();
+	}
 	if (szResult.size() < 10)
 		return m_szEmptyFieldResponse;
 	if (!bLocaltime)
@@ -1485,6 +3190,35 @@ std::string EvohomeClient2::get_system_mode_until(const evohome::device::tempera
 }
 
 
+/*
+ * Return a status member of a device, or NULL if it was not reported
+ *
+ * Members are resolved once for every status update and then kept in the
+ * device, so that repeated reads do not search the status tree.
+ */
+/* private */ const Json::Value *EvohomeClient2::get_status_field(const evohome::device::zone *zone, const unsigned int fieldIdx)
+{
+	if ((*zone).statusFieldsGeneration != m_iStatusGeneration)
+	{
+		unsigned int firstKey = ((*zone).zoneIdx & 128) ? 4 : 0;
+		for (unsigned int i = 0; i < 4; i++)
+			(*zone).jStatusFields[i] = evohome::json::find(evohome::json::find((*zone).jStatus, statusFieldKeys[firstKey + i][0]), statusFieldKeys[firstKey + i][1]);
+		(*zone).statusFieldsGeneration = m_iStatusGeneration;
+	}
+	return (*zone).jStatusFields[fieldIdx];
+}
+/* private */ const Json::Value *EvohomeClient2::get_status_field(const evohome::device::temperatureControlSystem *tcs, const unsigned int fieldIdx)
+{
+	if ((*tcs).statusFieldsGeneration != m_iStatusGeneration)
+	{
+		for (unsigned int i = 0; i < 2; i++)
+			(*tcs).jStatusFields[i] = evohome::json::find(evohome::json::find((*tcs).jStatus, statusFieldKeys[8 + i][0]), statusFieldKeys[8 + i][1]);
+		(*tcs).statusFieldsGeneration = m_iStatusGeneration;
+	}
+	return (*tcs).jStatusFields[fieldIdx];
+}
+
+
 /************************************************************************
  *									*
  *	Sanity checks							*
@@ -12,8 +12,22 @@
 
 #include <vector>
 #include <string>
+#include <map>
+#include <set>
+#include <memory>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include "jsoncpp/json.h"
 #include "../common/devices.hpp"
+#include "../common/events.hpp"
+#include "../common/snapshot.hpp"
+#include "../common/commands.hpp"
+#include "../common/schedules.hpp"
+#include "../common/ScheduleCache.hpp"
+#include "../connection/EvoHTTPBridge.hpp"
 
 
 class EvohomeClient2
@@ -56,6 +70,23 @@ public:
  *	it will automatically try to renew it and save the new token	*
  *	back to the file on success.					*
  *									*
+ *	Processes that share an auth file coordinate through a lock	*
+ *	file next to it: only one process renews an expired token and	*
+ *	the file is always replaced atomically. After a load or save	*
+ *	every renewal by this client is written back to the file.	*
+ *									*
+ *	The auth file also stores the user ID. If load_auth_from_file()	*
+ *	finds a valid token together with a user ID it restores the	*
+ *	session without making any call to the portal. Files written	*
+ *	by older versions still trigger a user account request.	*
+ *									*
+ *	When a token refresh margin is set, requests made within that	*
+ *	many seconds before the token expires will first renew the	*
+ *	session. Only one thread performs the renewal, other threads	*
+ *	continue with the current token while it is still valid. A	*
+ *	failed renewal is retried after a minute at the earliest, or	*
+ *	right away once the token has expired.				*
+ *									*
  ************************************************************************/
 
 	bool login(const std::string &szUser, const std::string &szPassword);
@@ -63,6 +94,8 @@ public:
 	bool save_auth_to_file(const std::string &szFilename);
 	bool load_auth_from_file(const std::string &szFilename);
 	bool is_session_valid();
+	time_t get_token_expiration_time();
+	void set_token_refresh_margin(const int seconds);
 
 
 /************************************************************************
@@ -75,9 +108,36 @@ public:
  *	adding or removing hardware components, you will only need to	*
  *	make this call once at the start of your application.		*
  *									*
+ *	Repeated calls send the portal's ETag and Last-Modified values	*
+ *	back as a conditional request. If the portal reports that the	*
+ *	installation did not change, the existing structs are kept.	*
+ *									*
+ *	release_installation() drops the installation and status trees	*
+ *	to free memory while keeping the session. A following call to	*
+ *	full_installation() fetches the installation again.		*
+ *									*
+ *	With the installation filter enabled the response is read with	*
+ *	an event driven parser that only keeps the members the library	*
+ *	uses. Everything else is skipped without being stored. Use	*
+ *	add_installation_field() to keep more members. Paths are dot	*
+ *	separated member names from the root, e.g. "locations.gateways"	*
+ *									*
+ *	With incremental installation updates enabled a changed	*
+ *	installation is reconciled against the existing structs by	*
+ *	ID instead of rebuilding them. Devices that were added or	*
+ *	removed are the only ones created or destroyed, and status,	*
+ *	schedules and pointers of the others are kept. Only where a	*
+ *	list of devices changed are the remaining members of that list	*
+ *	relocated; their children keep their addresses. Every change	*
+ *	is listed by get_installation_changes() until the next call.	*
+ *									*
  ************************************************************************/
 
 	bool full_installation();
+	void release_installation();
+	void set_installation_filter(const bool bEnable);
+	void add_installation_field(const std::string &szPath);
+	const std::vector<evohome::device::diff::change> &get_installation_changes();
 
 
 /************************************************************************
@@ -89,11 +149,47 @@ public:
  *	as either an index (0 if you only have one installation) or	*
  *	the seven digit unique ID assigned to your system as a string.	*
  *									*
+ *	By default the status tree of the location is rebuilt on every	*
+ *	call. With incremental status updates enabled the new status	*
+ *	is merged into the existing tree and only changed fields are	*
+ *	rewritten, so jStatus pointers remain valid between calls.	*
+ *									*
+ *	Every call compares the new values for zone temperature,	*
+ *	setpoint and mode, hot water state and system mode against	*
+ *	the previous call. get_status_changes() returns the values	*
+ *	that changed during the last call and a callback may be set	*
+ *	to receive each change as it is found.				*
+ *									*
+ *	With status snapshots enabled every successful call also	*
+ *	publishes an immutable copy of the status of all locations.	*
+ *	get_status_snapshot() may be called from any thread and the	*
+ *	returned snapshot remains valid for as long as it is held,	*
+ *	regardless of later calls to get_status().			*
+ *									*
+ *	With the status arena enabled a status tree that replaces the	*
+ *	previous one is allocated from a single memory region of the	*
+ *	location, which is released in one step when it is replaced	*
+ *	in turn. This does not apply to incremental updates.		*
+ *									*
+ *	With typed status enabled the response is decoded in a single	*
+ *	pass into the status structs of the devices and no json tree	*
+ *	is kept: jStatus pointers are NULL and the get_zone_* and	*
+ *	get_system_* functions read the typed values instead. Status	*
+ *	changes are reported as before. Incremental updates and status	*
+ *	snapshots only apply to the json tree.				*
+ *									*
  ************************************************************************/
 
 	bool get_status(const unsigned int locationIdx);
 	bool get_status(const std::string szLocationId);
 
+	const std::vector<evohome::event::change> &get_status_changes();
+	void set_status_change_callback(evohome::event::callback fCallback);
+
+	std::shared_ptr<const evohome::status::snapshot> get_status_snapshot();
+
+	void set_typed_status(const bool bEnable);
+
 
 /************************************************************************
  *									*
@@ -138,6 +234,12 @@ public:
  *									*
  *	Evohome overrides						*
  *									*
+ *	set_temperatures() sends the setpoints for many zones at once,	*
+ *	with at most maxConcurrent requests in flight. An entry with	*
+ *	an empty setpoint cancels the zone's override. The result of	*
+ *	each entry is returned in its bSuccess and szError fields and	*
+ *	the function only returns true if all entries succeeded.	*
+ *									*
  ************************************************************************/
 
 	bool set_system_mode(const std::string szSystemId, const unsigned int mode, const std::string szDateUntil = "");
@@ -145,11 +247,39 @@ public:
 
 	bool set_temperature(const std::string szZoneId, const std::string temperature, const std::string szTimeUntil = "");
 	bool cancel_temperature_override(const std::string szZoneId);
+	bool set_temperatures(std::vector<evohome::command::setpoint> &vSetpoints, const unsigned int maxConcurrent = 4);
 
 	bool set_dhw_mode(const std::string szDHWId, const std::string szMode, const std::string szTimeUntil = "");
 	bool cancel_dhw_override(const std::string szDHWId);
 
 
+/************************************************************************
+ *									*
+ *	Evohome command queue						*
+ *									*
+ *	The queue functions return immediately and send the command	*
+ *	from a background thread. A command that is queued for a zone,	*
+ *	hot water device or system that already has a command waiting	*
+ *	replaces that command, so that only the final value is sent.	*
+ *	Every caller still receives a completion notice; the callers	*
+ *	of replaced commands are notified with bSuperseded set.	*
+ *									*
+ *	Commands are held for at least the queue delay before they	*
+ *	are sent, and each replacement restarts this delay. Invalid	*
+ *	timestamps are rejected at once and nothing is queued.		*
+ *									*
+ *	The queue thread does not renew the session. The application	*
+ *	must keep the token valid as it does for direct calls.		*
+ *									*
+ ************************************************************************/
+
+	bool queue_temperature(const std::string szZoneId, const std::string temperature, const std::string szTimeUntil = "", evohome::command::completion fCompletion = nullptr);
+	bool queue_dhw_mode(const std::string szDHWId, const std::string szMode, const std::string szTimeUntil = "", evohome::command::completion fCompletion = nullptr);
+	bool queue_system_mode(const std::string szSystemId, const unsigned int mode, const std::string szDateUntil = "", evohome::command::completion fCompletion = nullptr);
+	void set_command_queue_delay(const int milliseconds);
+	void wait_for_command_queue();
+
+
 /************************************************************************
  *									*
  *	Return Data Fields						*
@@ -187,10 +317,36 @@ public:
  *									*
  *	Schedule handlers						*
  *									*
+ *	The extended schedules_restore() only sends the schedules that	*
+ *	differ from those on the controller. Current schedules are	*
+ *	fetched concurrently, using the loaded schedule when the portal	*
+ *	reports it unchanged, and compared in canonical form. vReport	*
+ *	receives an entry for every zone and hot water device in the	*
+ *	backup. With bDryRun set nothing is sent. A zone whose current	*
+ *	schedule cannot be retrieved is reported as not comparable and	*
+ *	keeps the schedule it had loaded.				*
+ *									*
+ *	Retrieved schedules are cached in the zone structs. With a	*
+ *	cache TTL set, get_next_switchpoint() on a schedule older than	*
+ *	the TTL returns the cached result and refreshes the schedule	*
+ *	in the background. The refreshed schedule is used from the	*
+ *	next call. Only a zone without any schedule is fetched before	*
+ *	returning. The TTL may be set for all zones and overridden for	*
+ *	single zones, 0 means that cached schedules never expire. A	*
+ *	successful set_zone_schedule() updates the cache at once.	*
+ *									*
+ *	save_schedule_cache() writes the loaded schedules to a binary	*
+ *	file as precompiled switchpoint tables. After a call to	*
+ *	load_schedule_cache() get_next_switchpoint() answers from the	*
+ *	memory mapped tables for zones that have no JSON schedule	*
+ *	loaded, without parsing. The binary file is tied to the	*
+ *	machine that wrote it, use schedules_backup() for exchange.	*
+ *									*
  ************************************************************************/
 
 	bool schedules_backup(const std::string &szFilename);
 	bool schedules_restore(const std::string &szFilename);
+	bool schedules_restore(const std::string &szFilename, std::vector<evohome::schedule::restore_item> &vReport, const bool bDryRun = false, const unsigned int maxConcurrent = 4);
 	bool load_schedules_from_file(const std::string &szFilename);
 
 	bool get_dhw_schedule(const std::string szDHWId);
@@ -206,6 +362,12 @@ public:
 
 	std::string request_next_switchpoint(const std::string szZoneId);
 
+	void set_schedule_cache_ttl(const int seconds);
+	void set_schedule_cache_ttl(const std::string szZoneId, const int seconds);
+
+	bool save_schedule_cache(const std::string &szFilename);
+	bool load_schedule_cache(const std::string &szFilename);
+
 
 /************************************************************************
  *									*
@@ -225,17 +387,67 @@ public:
  ************************************************************************/
 
 	void set_empty_field_response(std::string szResponse);
+	void set_incremental_status_update(const bool bEnable);
+	void set_incremental_installation_update(const bool bEnable);
+	void set_status_snapshots(const bool bEnable);
+	void set_status_arena(const bool bEnable);
 
 
 private:
 	void init();
-	bool obtain_access_token(const std::string &szCredentials);
-	bool request_user_id();
+	bool obtain_access_token(const std::string &szCredentials, std::string &szResponse);
+	bool request_user_id(std::string &szResponse);
+	bool renew_session();
+	bool refresh_access_token();
+	bool read_auth_file(const std::string &szFilename, Json::Value &jAuth);
+	bool write_auth_file(const std::string &szFilename);
+	void set_auth_from_json(const Json::Value &jAuth);
+	void set_auth_header();
+	void check_token_refresh();
+	std::vector<std::string> get_auth_header();
 
 	void get_gateways(const unsigned int locationIdx);
 	void get_temperatureControlSystems(const unsigned int locationIdx, const unsigned int gatewayIdx);
 	void get_zones(const unsigned int locationIdx, const unsigned int gatewayIdx, const unsigned int systemIdx);
 	void get_dhw(const unsigned int locationIdx, const unsigned int gatewayIdx, const unsigned int systemIdx);
+	void reconcile_locations();
+	void reconcile_gateways(const unsigned int locationIdx);
+	void reconcile_temperatureControlSystems(const unsigned int locationIdx, const unsigned int gatewayIdx);
+	void reconcile_zones(const unsigned int locationIdx, const unsigned int gatewayIdx, const unsigned int systemIdx);
+
+	void merge_status(Json::Value &jCurrent, Json::Value &jUpdate);
+	void collect_status_changes(const unsigned int locationIdx, const Json::Value &jNewStatus);
+	void publish_status_snapshot(const unsigned int locationIdx);
+	void add_status_change(const evohome::event::type::value eType, const unsigned int locationIdx, const std::string &szObjectId, const Json::Value &jOld, const Json::Value &jNew);
+	void add_status_change(const evohome::event::type::value eType, const unsigned int locationIdx, const std::string &szObjectId, const std::string &szOld, const std::string &szNew);
+	void apply_typed_status(const unsigned int locationIdx);
+	const Json::Value *get_status_field(const evohome::device::zone *zone, const unsigned int fieldIdx);
+	const Json::Value *get_status_field(const evohome::device::temperatureControlSystem *tcs, const unsigned int fieldIdx);
+	std::string format_temperature(const evohome::device::status::zone &statusZone);
+	std::string format_until(const time_t tUntil);
+
+	void enqueue_command(const evohome::command::type::value eType, const std::string &szTargetId, const std::string &szUrl, const std::string &szPutData, evohome::command::completion fCompletion);
+	void process_command_queue();
+	void stop_command_queue();
+
+	bool conditional_get(const std::string &szUrl, bool &bModified);
+	bool build_setpoint_body(std::string &szPutData, const std::string &szSetpoint, const std::string &szTimeUntil);
+	bool build_system_mode_body(std::string &szPutData, const unsigned int mode, const std::string &szDateUntil);
+	bool build_dhw_mode_body(std::string &szPutData, const std::string &szMode, const std::string &szTimeUntil);
+	void send_setpoints(std::vector<evohome::command::setpoint> &vSetpoints, std::atomic<size_t> &nextEntry, const std::vector<std::string> &vRequestHeader);
+
+	bool read_schedules_file(const std::string &szFilename, Json::Value &jSchedules);
+	void find_backup_schedules(Json::Value &jSchedules, std::map<std::string, Json::Value*> &mSchedules);
+	void fetch_zone_schedules(const std::vector<evohome::device::zone*> &vZones, const unsigned int maxConcurrent, std::vector<bool> &vFetched);
+	static void send_schedule_requests(std::vector<evohome::schedule::fetch> &vFetch, std::atomic<size_t> &nextEntry);
+
+	int get_schedule_ttl(const std::string &szZoneId);
+	bool is_schedule_stale(const evohome::device::zone *zone);
+	bool compile_schedule(const Json::Value &jSchedule, evohome::schedule::cache::zone &cacheZone);
+	void refresh_schedule_async(evohome::device::zone *zone);
+	void apply_schedule_updates();
+	void process_schedule_refresh();
+	void stop_schedule_refresh();
 
 	bool get_zone_schedule_ex(const std::string szZoneId, const unsigned int zoneType);
 	bool set_zone_schedule_ex(const std::string szZoneId, const unsigned int zoneType, Json::Value *jZoneSchedule);
@@ -256,13 +468,55 @@ private:
 	std::string m_szRefreshToken;
 	time_t m_tTokenExpirationTime;
 	std::vector<std::string> m_vEvoHeader;
+	int m_iTokenRefreshMargin;
+	time_t m_tTokenRefreshFailed;
+	std::string m_szAuthFile;
+	std::mutex m_mtxAuthHeader;
+	std::mutex m_mtxTokenRefresh;
 
 	std::string m_szLastError;
 	std::string m_szResponse;
+	std::string m_szPutData;
 
 	std::vector<evohome::device::path::zone> m_vZonePaths;
+	std::map<std::string, evohome::API::request::validator> m_mValidators;
 
 	std::string m_szEmptyFieldResponse;
+	bool m_bIncrementalStatus;
+	bool m_bInstallationFilter;
+	std::vector<std::string> m_vInstallationFields;
+	bool m_bIncrementalInstallation;
+	std::vector<evohome::device::diff::change> m_vInstallationChanges;
+
+	std::vector<evohome::event::change> m_vStatusChanges;
+	evohome::event::callback m_fStatusChangeCallback;
+
+	bool m_bTypedStatus;
+	bool m_bStatusArena;
+	unsigned int m_iStatusGeneration;
+	evohome::device::status::location m_statusDecoded;
+
+	bool m_bStatusSnapshots;
+	std::shared_ptr<const evohome::status::snapshot> m_pStatusSnapshot;
+
+	std::list<evohome::command::queued> m_lCommandQueue;
+	std::thread m_tCommandQueue;
+	std::mutex m_mtxCommandQueue;
+	std::condition_variable m_cvCommandQueue;
+	bool m_bCommandQueueStop;
+	bool m_bCommandInFlight;
+	int m_iCommandQueueDelay;
+
+	ScheduleCache m_scheduleCache;
+	int m_iScheduleTTL;
+	std::map<std::string, int> m_mScheduleTTL;
+	std::list<evohome::schedule::refresh> m_lScheduleRequests;
+	std::list<evohome::schedule::refresh> m_lScheduleResults;
+	std::set<std::string> m_sScheduleRefreshIds;
+	std::thread m_tScheduleRefresh;
+	std::mutex m_mtxScheduleRefresh;
+	std::condition_variable m_cvScheduleRefresh;
+	bool m_bScheduleRefreshStop;
 };
 
 #endif
@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Background status poller for UK/EMEA Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <ctime>
+#include "evohomepoller.hpp"
+#include "../time/IsoTimeString.hpp"
+
+
+#define POLLER_DEFAULT_INTERVAL 300
+#define POLLER_DEFAULT_JITTER 10
+#define POLLER_DEFAULT_TOKEN_MARGIN 300
+#define POLLER_TOKEN_RETRY_DELAY 60
+#define POLLER_DEFAULT_SWITCHPOINT_DELAY 30
+
+
+/*
+ * Class construct
+ */
+EvohomePoller::EvohomePoller(EvohomeClient2 *client)
+{
+	m_pClient = client;
+	m_bRunning = false;
+	m_bStopRequested = false;
+
+	m_iInterval = POLLER_DEFAULT_INTERVAL;
+	m_iJitter = POLLER_DEFAULT_JITTER;
+	m_iTokenRefreshMargin = POLLER_DEFAULT_TOKEN_MARGIN;
+	m_iMinInterval = 0;
+	m_iMaxInterval = 0;
+	m_iSwitchpointDelay = POLLER_DEFAULT_SWITCHPOINT_DELAY;
+	m_iNextSubscriberId = 1;
+
+	std::random_device rd;
+	m_rng.seed(rd());
+}
+
+
+EvohomePoller::~EvohomePoller()
+{
+	stop();
+}
+
+
+/************************************************************************
+ *									*
+ *	Thread control							*
+ *									*
+ ************************************************************************/
+
+
+bool EvohomePoller::start()
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	if (m_bRunning)
+		return false;
+	if (m_thread.joinable())
+		m_thread.join();
+
+	m_bStopRequested = false;
+	m_bRunning = true;
+	m_thread = std::thread(&EvohomePoller::run, this);
+	return true;
+}
+
+
+void EvohomePoller::stop()
+{
+	bool bRunning;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		bRunning = m_bRunning;
+		if (bRunning)
+			m_bStopRequested = true;
+	}
+	if (bRunning)
+		m_cvState.notify_all();
+
+	if (std::this_thread::get_id() == m_thread.get_id())
+		return; // called from a subscriber - the worker thread exits when it returns
+
+	// also reap a worker that was stopped by a subscriber and has already finished
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+
+bool EvohomePoller::is_running()
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	return m_bRunning;
+}
+
+
+/************************************************************************
+ *									*
+ *	Config options							*
+ *									*
+ ************************************************************************/
+
+
+void EvohomePoller::set_interval(const int seconds)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		m_iInterval = (seconds > 0) ? seconds : 1;
+	}
+	m_cvState.notify_all();
+}
+
+
+void EvohomePoller::set_jitter(const int seconds)
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	m_iJitter = (seconds > 0) ? seconds : 0;
+}
+
+
+void EvohomePoller::set_token_refresh_margin(const int seconds)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		m_iTokenRefreshMargin = (seconds > 0) ? seconds : 0;
+	}
+	m_cvState.notify_all();
+}
+
+
+/*
+ * Enable adaptive poll intervals, a minimum of 0 restores the fixed interval
+ */
+void EvohomePoller::set_adaptive_interval(const int minSeconds, const int maxSeconds)
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	m_iMinInterval = (minSeconds > 0) ? minSeconds : 0;
+	m_iMaxInterval = (maxSeconds > m_iMinInterval) ? maxSeconds : m_iMinInterval;
+}
+
+
+/*
+ * Time to wait after a switchpoint before polling, allowing the change to reach the portal
+ */
+void EvohomePoller::set_switchpoint_delay(const int seconds)
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	m_iSwitchpointDelay = (seconds > 0) ? seconds : 0;
+}
+
+
+/************************************************************************
+ *									*
+ *	Subscribers							*
+ *									*
+ ************************************************************************/
+
+
+int EvohomePoller::subscribe(evohome::poller::subscriber fSubscriber)
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	int subscriberId = m_iNextSubscriberId++;
+	m_mSubscribers[subscriberId] = fSubscriber;
+	return subscriberId;
+}
+
+
+void EvohomePoller::unsubscribe(const int subscriberId)
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	m_mSubscribers.erase(subscriberId);
+}
+
+
+/************************************************************************
+ *									*
+ *	Client access							*
+ *									*
+ ************************************************************************/
+
+
+bool EvohomePoller::execute(std::function<bool(EvohomeClient2*)> fCommand)
+{
+	std::lock_guard<std::mutex> lock(m_mtxClient);
+	return fCommand(m_pClient);
+}
+
+
+/************************************************************************
+ *									*
+ *	Worker thread							*
+ *									*
+ ************************************************************************/
+
+
+/* private */ void EvohomePoller::run()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxClient);
+		m_pClient->set_status_snapshots(true);
+		if (m_pClient->m_vLocations.empty())
+			m_pClient->full_installation();
+	}
+	init_schedules();
+	m_tNextTokenAttempt = std::chrono::steady_clock::now();
+
+	// never hold m_mtxState while acquiring m_mtxClient: execute() may call back into our config functions
+	std::unique_lock<std::mutex> lock(m_mtxState);
+	while (!m_bStopRequested)
+	{
+		lock.unlock();
+		std::chrono::steady_clock::time_point tTokenRefresh = get_token_refresh_time();
+		lock.lock();
+		if (m_bStopRequested)
+			break;
+
+		std::chrono::steady_clock::time_point tWake = tTokenRefresh;
+		for (std::vector<evohome::poller::schedule>::iterator it = m_vSchedules.begin(); it != m_vSchedules.end(); ++it)
+		{
+			if (it->tNextPoll < tWake)
+				tWake = it->tNextPoll;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (tWake > now)
+		{
+			// woken early on stop or configuration change - re-evaluate
+			m_cvState.wait_until(lock, tWake);
+			continue;
+		}
+
+		lock.unlock();
+		if (tTokenRefresh <= now)
+			refresh_token();
+
+		size_t numSchedules = m_vSchedules.size();
+		for (size_t i = 0; i < numSchedules; i++)
+		{
+			if (m_vSchedules[i].tNextPoll <= now)
+				poll_location(&m_vSchedules[i]);
+		}
+
+		bool bReinit;
+		{
+			std::lock_guard<std::mutex> clientlock(m_mtxClient);
+			bReinit = (m_pClient->m_vLocations.size() != m_vSchedules.size());
+		}
+		if (bReinit)
+			init_schedules();
+		lock.lock();
+	}
+	m_bRunning = false;
+}
+
+
+/*
+ * Spread the locations evenly across the poll interval
+ */
+/* private */ void EvohomePoller::init_schedules()
+{
+	size_t numLocations;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxClient);
+		numLocations = m_pClient->m_vLocations.size();
+	}
+	int interval;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		interval = m_iInterval;
+	}
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	m_vSchedules.clear();
+	for (size_t i = 0; i < numLocations; i++)
+	{
+		evohome::poller::schedule newSchedule = evohome::poller::schedule();
+		newSchedule.locationIdx = static_cast<unsigned int>(i);
+		newSchedule.interval = interval;
+		newSchedule.tNextPoll = now + std::chrono::milliseconds(static_cast<long long>(interval) * 1000 * i / numLocations);
+		m_vSchedules.push_back(newSchedule);
+	}
+}
+
+
+/* private */ void EvohomePoller::poll_location(evohome::poller::schedule *locationSchedule)
+{
+	bool bSuccess;
+	std::vector<evohome::event::change> vChanges;
+	std::shared_ptr<const evohome::status::snapshot> pSnapshot;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxClient);
+		bSuccess = m_pClient->get_status(locationSchedule->locationIdx);
+		vChanges = m_pClient->get_status_changes();
+		pSnapshot = m_pClient->get_status_snapshot();
+	}
+
+	time_t tSwitchpoint = get_next_switchpoint_time(locationSchedule->locationIdx);
+
+	std::map<int, evohome::poller::subscriber> mSubscribers;
+	int switchpointDelay;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		locationSchedule->interval = get_next_interval(locationSchedule, !vChanges.empty());
+		switchpointDelay = m_iSwitchpointDelay;
+		mSubscribers = m_mSubscribers;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	locationSchedule->tNextPoll = now + std::chrono::seconds(locationSchedule->interval) + std::chrono::milliseconds(get_jitter_offset());
+
+	if (tSwitchpoint > 0)
+	{
+		// poll shortly after the next scheduled change if that comes before the regular poll
+		std::chrono::steady_clock::time_point tAfterSwitchpoint = now + std::chrono::seconds(static_cast<long long>(tSwitchpoint - time(NULL)) + switchpointDelay);
+		if ((tAfterSwitchpoint > now) && (tAfterSwitchpoint < locationSchedule->tNextPoll))
+			locationSchedule->tNextPoll = tAfterSwitchpoint;
+	}
+
+	for (std::map<int, evohome::poller::subscriber>::iterator it = mSubscribers.begin(); it != mSubscribers.end(); ++it)
+		it->second(locationSchedule->locationIdx, bSuccess, pSnapshot, vChanges);
+}
+
+
+/*
+ * Renew the session ahead of token expiration
+ */
+/* private */ void EvohomePoller::refresh_token()
+{
+	bool bRenewed;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxClient);
+		bRenewed = m_pClient->renew_login();
+	}
+	if (!bRenewed)
+		m_tNextTokenAttempt = std::chrono::steady_clock::now() + std::chrono::seconds(POLLER_TOKEN_RETRY_DELAY);
+}
+
+
+/* private */ std::chrono::steady_clock::time_point EvohomePoller::get_token_refresh_time()
+{
+	time_t tExpiration;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxClient);
+		tExpiration = m_pClient->get_token_expiration_time();
+	}
+	int margin;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		margin = m_iTokenRefreshMargin;
+	}
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (tExpiration == 0)
+		return now + std::chrono::hours(24); // no session known
+
+	long long secondsLeft = static_cast<long long>(tExpiration - time(NULL)) - margin;
+	std::chrono::steady_clock::time_point tRefresh = now + std::chrono::seconds(secondsLeft);
+	if (tRefresh < m_tNextTokenAttempt)
+		return m_tNextTokenAttempt;
+	return tRefresh;
+}
+
+
+/* private */ int EvohomePoller::get_jitter_offset()
+{
+	int jitter;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		jitter = m_iJitter;
+	}
+	if (jitter == 0)
+		return 0;
+	std::uniform_int_distribution<int> distribution(-jitter * 1000, jitter * 1000);
+	return distribution(m_rng);
+}
+
+
+/*
+ * Determine the poll interval for a location, must be called with m_mtxState held
+ */
+/* private */ int EvohomePoller::get_next_interval(const evohome::poller::schedule *locationSchedule, const bool bChanged)
+{
+	if (m_iMinInterval == 0)
+		return m_iInterval;
+	if (bChanged)
+		return m_iMinInterval;
+
+	// back off by 50% for every poll that found no changes
+	int interval = locationSchedule->interval + (locationSchedule->interval / 2) + 1;
+	if (interval < m_iMinInterval)
+		return m_iMinInterval;
+	if (interval > m_iMaxInterval)
+		return m_iMaxInterval;
+	return interval;
+}
+
+
+/*
+ * Find the earliest upcoming switchpoint from the schedules that the client already holds
+ */
+/* private */ time_t EvohomePoller::get_next_switchpoint_time(const unsigned int locationIdx)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		if (m_iMinInterval == 0)
+			return 0;
+	}
+
+	time_t tEarliest = 0;
+	std::lock_guard<std::mutex> lock(m_mtxClient);
+	if (locationIdx >= static_cast<unsigned int>(m_pClient->m_vLocations.size()))
+		return 0;
+
+	evohome::device::location *myLocation = &m_pClient->m_vLocations[locationIdx];
+	for (size_t igw = 0; igw < myLocation->gateways.size(); igw++)
+	{
+		for (size_t itcs = 0; itcs < myLocation->gateways[igw].temperatureControlSystems.size(); itcs++)
+		{
+			evohome::device::temperatureControlSystem *myTCS = &myLocation->gateways[igw].temperatureControlSystems[itcs];
+			std::vector<evohome::device::zone*> vZones;
+			for (size_t iz = 0; iz < myTCS->zones.size(); iz++)
+				vZones.push_back(&myTCS->zones[iz]);
+			for (size_t iz = 0; iz < myTCS->dhw.size(); iz++)
+				vZones.push_back(&myTCS->dhw[iz]);
+
+			for (size_t iz = 0; iz < vZones.size(); iz++)
+			{
+				if (vZones[iz]->jSchedule.isNull())
+					continue;
+				time_t tSwitchpoint = IsoTimeString::local_to_time_t(m_pClient->get_next_switchpoint(vZones[iz]));
+				if ((tSwitchpoint > 0) && ((tEarliest == 0) || (tSwitchpoint < tEarliest)))
+					tEarliest = tSwitchpoint;
+			}
+		}
+	}
+	return tEarliest;
+}
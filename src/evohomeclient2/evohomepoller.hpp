@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Background status poller for UK/EMEA Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#ifndef _EvohomePoller
+#define _EvohomePoller
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <random>
+#include <functional>
+#include "evohomeclient2.hpp"
+
+
+namespace evohome {
+  namespace poller {
+
+    typedef std::function<void(const unsigned int locationIdx, const bool bSuccess, std::shared_ptr<const evohome::status::snapshot> pSnapshot, const std::vector<evohome::event::change> &vChanges)> subscriber;
+
+    typedef struct _sSchedule
+    {
+      unsigned int locationIdx;
+      int interval;
+      std::chrono::steady_clock::time_point tNextPoll;
+    } schedule;
+
+  }; // namespace poller
+
+}; // namespace evohome
+
+
+class EvohomePoller
+{
+public:
+/************************************************************************
+ *									*
+ *	Class construct							*
+ *									*
+ *	The poller owns a worker thread that calls get_status() on the	*
+ *	client for every location and renews the session before the	*
+ *	access token expires. The client must be logged in before the	*
+ *	poller is started. While the poller is running all other calls	*
+ *	to the client must go through execute().			*
+ *									*
+ ************************************************************************/
+
+	EvohomePoller(EvohomeClient2 *client);
+	~EvohomePoller();
+
+	bool start();
+	void stop();
+	bool is_running();
+
+
+/************************************************************************
+ *									*
+ *	Config options							*
+ *									*
+ *	Every location is polled once per interval. Locations are	*
+ *	spread evenly across the interval and each poll is moved by	*
+ *	a random offset of at most jitter seconds to avoid bursts.	*
+ *									*
+ *	With adaptive intervals enabled each location starts at the	*
+ *	minimum interval after a poll that found changes and backs off	*
+ *	towards the maximum interval while nothing changes. A poll is	*
+ *	also scheduled shortly after the next known switchpoint of any	*
+ *	zone in the location. Only schedules that are already loaded	*
+ *	in the client are used for this, they are never fetched.	*
+ *									*
+ ************************************************************************/
+
+	void set_interval(const int seconds);
+	void set_jitter(const int seconds);
+	void set_token_refresh_margin(const int seconds);
+	void set_adaptive_interval(const int minSeconds, const int maxSeconds);
+	void set_switchpoint_delay(const int seconds);
+
+
+/************************************************************************
+ *									*
+ *	Subscribers							*
+ *									*
+ *	Subscribers are called from the worker thread after every poll	*
+ *	with the published status snapshot and the detected changes.	*
+ *									*
+ ************************************************************************/
+
+	int subscribe(evohome::poller::subscriber fSubscriber);
+	void unsubscribe(const int subscriberId);
+
+
+/************************************************************************
+ *									*
+ *	Client access							*
+ *									*
+ *	execute() runs fCommand with exclusive access to the client.	*
+ *									*
+ ************************************************************************/
+
+	bool execute(std::function<bool(EvohomeClient2*)> fCommand);
+
+
+private:
+	void run();
+	void init_schedules();
+	void poll_location(evohome::poller::schedule *locationSchedule);
+	void refresh_token();
+	std::chrono::steady_clock::time_point get_token_refresh_time();
+	int get_jitter_offset();
+	int get_next_interval(const evohome::poller::schedule *locationSchedule, const bool bChanged);
+	time_t get_next_switchpoint_time(const unsigned int locationIdx);
+
+private:
+	EvohomeClient2 *m_pClient;
+
+	std::thread m_thread;
+	std::mutex m_mtxClient;
+	std::mutex m_mtxState;
+	std::condition_variable m_cvState;
+	bool m_bRunning;
+	bool m_bStopRequested;
+
+	int m_iInterval;
+	int m_iJitter;
+	int m_iTokenRefreshMargin;
+	int m_iMinInterval;
+	int m_iMaxInterval;
+	int m_iSwitchpointDelay;
+	std::chrono::steady_clock::time_point m_tNextTokenAttempt;
+
+	std::vector<evohome::poller::schedule> m_vSchedules;
+	std::map<int, evohome::poller::subscriber> m_mSubscribers;
+	int m_iNextSubscriberId;
+
+	std::mt19937 m_rng;
+};
+
+#endif
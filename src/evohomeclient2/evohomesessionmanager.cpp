@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Multi-account session manager for UK/EMEA Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <ctime>
+#include <algorithm>
+#include "evohomesessionmanager.hpp"
+
+
+#define SESSION_DEFAULT_TOKEN_MARGIN 300
+#define SESSION_DEFAULT_BATCH_SIZE 20
+#define SESSION_BATCH_PAUSE 1
+#define SESSION_TOKEN_RETRY_DELAY 60
+#define SESSION_MAX_SLEEP 300
+
+
+/*
+ * Class construct
+ */
+EvohomeSessionManager::EvohomeSessionManager()
+{
+	m_bRunning = false;
+	m_bStopRequested = false;
+
+	m_iTokenRefreshMargin = SESSION_DEFAULT_TOKEN_MARGIN;
+	m_iRefreshBatchSize = SESSION_DEFAULT_BATCH_SIZE;
+	m_iMaxLoadedInstallations = 0;
+}
+
+
+EvohomeSessionManager::~EvohomeSessionManager()
+{
+	stop();
+	std::lock_guard<std::mutex> lock(m_mtxAccounts);
+	m_mAccounts.clear();
+	m_lLoadedInstallations.clear();
+}
+
+
+/************************************************************************
+ *									*
+ *	Thread control							*
+ *									*
+ ************************************************************************/
+
+
+bool EvohomeSessionManager::start()
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	if (m_bRunning)
+		return false;
+	if (m_thread.joinable())
+		m_thread.join();
+
+	m_bStopRequested = false;
+	m_bRunning = true;
+	m_thread = std::thread(&EvohomeSessionManager::run, this);
+	return true;
+}
+
+
+void EvohomeSessionManager::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		if (!m_bRunning)
+			return;
+		m_bStopRequested = true;
+	}
+	m_cvState.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+
+bool EvohomeSessionManager::is_running()
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	return m_bRunning;
+}
+
+
+/************************************************************************
+ *									*
+ *	Config options							*
+ *									*
+ ************************************************************************/
+
+
+void EvohomeSessionManager::set_token_refresh_margin(const int seconds)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		m_iTokenRefreshMargin = (seconds > 0) ? seconds : 0;
+	}
+	m_cvState.notify_all();
+}
+
+
+void EvohomeSessionManager::set_refresh_batch_size(const int batchSize)
+{
+	std::lock_guard<std::mutex> lock(m_mtxState);
+	m_iRefreshBatchSize = (batchSize > 0) ? batchSize : 1;
+}
+
+
+/*
+ * Keep at most this many installations loaded, 0 disables the limit
+ */
+void EvohomeSessionManager::set_max_loaded_installations(const int maxLoaded)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		m_iMaxLoadedInstallations = (maxLoaded > 0) ? maxLoaded : 0;
+	}
+	trim_installations("");
+}
+
+
+/*
+ * The rate limit applies to all requests made by this process
+ */
+void EvohomeSessionManager::set_rate_limit(const double dRequestsPerSecond, const int iBurst)
+{
+	EvoHTTPBridge::SetRateLimit(dRequestsPerSecond, iBurst);
+}
+
+
+/************************************************************************
+ *									*
+ *	Accounts							*
+ *									*
+ ************************************************************************/
+
+
+bool EvohomeSessionManager::add_account(const std::string &szAccountId, const std::string &szUser, const std::string &szPassword, const std::string &szAuthFile)
+{
+	std::shared_ptr<evohome::session::account> pAccount = std::make_shared<evohome::session::account>();
+	pAccount->szAccountId = szAccountId;
+	pAccount->szUser = szUser;
+	pAccount->szPassword = szPassword;
+	pAccount->szAuthFile = szAuthFile;
+	pAccount->client.reset(new EvohomeClient2());
+	pAccount->tTokenExpiration = 0;
+	pAccount->bInstallationLoaded = false;
+
+	std::lock_guard<std::mutex> lock(m_mtxAccounts);
+	if (m_mAccounts.find(szAccountId) != m_mAccounts.end())
+		return false;
+	m_mAccounts[szAccountId] = pAccount;
+	return true;
+}
+
+
+/*
+ * Remove an account, a command that is running for it will complete first
+ */
+bool EvohomeSessionManager::remove_account(const std::string &szAccountId)
+{
+	std::shared_ptr<evohome::session::account> pAccount;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAccounts);
+		std::map<std::string, std::shared_ptr<evohome::session::account> >::iterator it = m_mAccounts.find(szAccountId);
+		if (it == m_mAccounts.end())
+			return false;
+		pAccount = it->second;
+		m_mAccounts.erase(it);
+		m_lLoadedInstallations.remove(szAccountId);
+	}
+	std::lock_guard<std::mutex> clientlock(pAccount->mtxClient);
+	return true;
+}
+
+
+std::vector<std::string> EvohomeSessionManager::get_account_ids()
+{
+	std::vector<std::string> vAccountIds;
+	std::lock_guard<std::mutex> lock(m_mtxAccounts);
+	vAccountIds.reserve(m_mAccounts.size());
+	std::map<std::string, std::shared_ptr<evohome::session::account> >::iterator it;
+	for (it = m_mAccounts.begin(); it != m_mAccounts.end(); ++it)
+		vAccountIds.push_back(it->first);
+	return vAccountIds;
+}
+
+
+size_t EvohomeSessionManager::get_account_count()
+{
+	std::lock_guard<std::mutex> lock(m_mtxAccounts);
+	return m_mAccounts.size();
+}
+
+
+/* private */ std::shared_ptr<evohome::session::account> EvohomeSessionManager::find_account(const std::string &szAccountId)
+{
+	std::lock_guard<std::mutex> lock(m_mtxAccounts);
+	std::map<std::string, std::shared_ptr<evohome::session::account> >::iterator it = m_mAccounts.find(szAccountId);
+	if (it == m_mAccounts.end())
+		return std::shared_ptr<evohome::session::account>();
+	return it->second;
+}
+
+
+/************************************************************************
+ *									*
+ *	Client access							*
+ *									*
+ ************************************************************************/
+
+
+bool EvohomeSessionManager::execute(const std::string &szAccountId, std::function<bool(EvohomeClient2*)> fCommand)
+{
+	std::shared_ptr<evohome::session::account> pAccount = find_account(szAccountId);
+	if (!pAccount)
+		return false;
+
+	bool bResult = false;
+	{
+		std::lock_guard<std::mutex> lock(pAccount->mtxClient);
+		EvohomeClient2 *client = pAccount->client.get();
+		if (open_session(pAccount.get()) && (!client->m_vLocations.empty() || client->full_installation()))
+			bResult = fCommand(client);
+		update_account_state(pAccount.get());
+	}
+
+	trim_installations(szAccountId);
+
+	// the session may expire before the worker's next planned wake up
+	m_cvState.notify_all();
+	return bResult;
+}
+
+
+/*
+ * Make sure the client has a valid session, must be called with the account's client lock held
+ */
+/* private */ bool EvohomeSessionManager::open_session(evohome::session::account *pAccount)
+{
+	EvohomeClient2 *client = pAccount->client.get();
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		client->set_token_refresh_margin(m_iTokenRefreshMargin);
+	}
+
+	if (client->is_session_valid())
+		return true;
+	if (!pAccount->szAuthFile.empty() && client->load_auth_from_file(pAccount->szAuthFile))
+		return true;
+	if ((client->get_token_expiration_time() != 0) && client->renew_login())
+		return true;
+	if (pAccount->szUser.empty())
+		return false;
+	if (!client->login(pAccount->szUser, pAccount->szPassword))
+		return false;
+	if (!pAccount->szAuthFile.empty())
+		client->save_auth_to_file(pAccount->szAuthFile);
+	return true;
+}
+
+
+/*
+ * Copy the client state that the worker and trimming use, must be called with the account's client lock held
+ */
+/* private */ void EvohomeSessionManager::update_account_state(evohome::session::account *pAccount)
+{
+	time_t tTokenExpiration = pAccount->client->get_token_expiration_time();
+	bool bInstallationLoaded = !pAccount->client->m_vLocations.empty();
+
+	std::lock_guard<std::mutex> lock(m_mtxAccounts);
+	pAccount->tTokenExpiration = tTokenExpiration;
+	pAccount->bInstallationLoaded = bInstallationLoaded;
+	if (m_mAccounts.find(pAccount->szAccountId) == m_mAccounts.end())
+		return; // account was removed
+
+	m_lLoadedInstallations.remove(pAccount->szAccountId);
+	if (bInstallationLoaded)
+		m_lLoadedInstallations.push_front(pAccount->szAccountId);
+}
+
+
+/*
+ * Release the least recently used installations above the configured maximum
+ *
+ * Accounts that are busy are skipped, they move to the front of the list when
+ * their command completes.
+ */
+/* private */ void EvohomeSessionManager::trim_installations(const std::string &szKeepId)
+{
+	int maxLoaded;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		maxLoaded = m_iMaxLoadedInstallations;
+	}
+	if (maxLoaded == 0)
+		return;
+
+	std::vector<std::shared_ptr<evohome::session::account> > vRelease;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAccounts);
+		while (static_cast<int>(m_lLoadedInstallations.size()) > maxLoaded)
+		{
+			std::string szAccountId = m_lLoadedInstallations.back();
+			m_lLoadedInstallations.pop_back();
+			if (szAccountId == szKeepId)
+			{
+				m_lLoadedInstallations.push_front(szAccountId);
+				continue;
+			}
+			std::map<std::string, std::shared_ptr<evohome::session::account> >::iterator it = m_mAccounts.find(szAccountId);
+			if (it != m_mAccounts.end())
+				vRelease.push_back(it->second);
+		}
+	}
+
+	std::vector<std::shared_ptr<evohome::session::account> >::iterator it;
+	for (it = vRelease.begin(); it != vRelease.end(); ++it)
+	{
+		std::unique_lock<std::mutex> clientlock((*it)->mtxClient, std::try_to_lock);
+		if (!clientlock.owns_lock())
+			continue;
+		(*it)->client->release_installation();
+		update_account_state((*it).get());
+	}
+}
+
+
+/************************************************************************
+ *									*
+ *	Worker thread							*
+ *									*
+ ************************************************************************/
+
+
+/* private */ void EvohomeSessionManager::run()
+{
+	std::unique_lock<std::mutex> lock(m_mtxState);
+	while (!m_bStopRequested)
+	{
+		lock.unlock();
+		std::chrono::steady_clock::time_point tNextWake;
+		int remaining = refresh_due_tokens(tNextWake);
+		if (remaining > 0)
+			tNextWake = std::chrono::steady_clock::now() + std::chrono::seconds(SESSION_BATCH_PAUSE);
+		lock.lock();
+
+		if (m_bStopRequested)
+			break;
+		m_cvState.wait_until(lock, tNextWake);
+	}
+	m_bRunning = false;
+}
+
+
+/*
+ * Renew one batch of sessions that are about to expire
+ *
+ * Returns the number of sessions that are still due after this batch and sets
+ * tNextWake to the time the next session becomes due.
+ */
+/* private */ int EvohomeSessionManager::refresh_due_tokens(std::chrono::steady_clock::time_point &tNextWake)
+{
+	int margin, batchSize;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxState);
+		margin = m_iTokenRefreshMargin;
+		batchSize = m_iRefreshBatchSize;
+	}
+
+	std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+	time_t tNowTime = time(NULL);
+	tNextWake = tNow + std::chrono::seconds(SESSION_MAX_SLEEP);
+
+	std::vector<std::pair<time_t, std::shared_ptr<evohome::session::account> > > vDue;
+	{
+		std::lock_guard<std::mutex> lock(m_mtxAccounts);
+		std::map<std::string, std::shared_ptr<evohome::session::account> >::iterator it;
+		for (it = m_mAccounts.begin(); it != m_mAccounts.end(); ++it)
+		{
+			evohome::session::account *pAccount = it->second.get();
+			if (pAccount->tTokenExpiration == 0)
+				continue; // session was never opened
+			time_t tDue = pAccount->tTokenExpiration - margin;
+			if ((tDue <= tNowTime) && (pAccount->tNextRenewal <= tNow))
+			{
+				vDue.push_back(std::make_pair(pAccount->tTokenExpiration, it->second));
+				continue;
+			}
+			std::chrono::steady_clock::time_point tAccountWake = (tDue <= tNowTime) ? pAccount->tNextRenewal : tNow + std::chrono::seconds(tDue - tNowTime);
+			if (tAccountWake < tNextWake)
+				tNextWake = tAccountWake;
+		}
+	}
+	if (vDue.empty())
+		return 0;
+
+	// renew the sessions that expire first
+	size_t batchEnd = std::min(vDue.size(), static_cast<size_t>(batchSize));
+	std::partial_sort(vDue.begin(), vDue.begin() + batchEnd, vDue.end(),
+		[](const std::pair<time_t, std::shared_ptr<evohome::session::account> > &a, const std::pair<time_t, std::shared_ptr<evohome::session::account> > &b) { return a.first < b.first; });
+
+	for (size_t i = 0; i < batchEnd; i++)
+	{
+		evohome::session::account *pAccount = vDue[i].second.get();
+		std::lock_guard<std::mutex> clientlock(pAccount->mtxClient);
+		EvohomeClient2 *client = pAccount->client.get();
+
+		// skip if the session was renewed by a command while we were waiting
+		if (client->get_token_expiration_time() - margin > time(NULL))
+		{
+			update_account_state(pAccount);
+			continue;
+		}
+
+		bool bRenewed = client->renew_login();
+		if (!bRenewed && !pAccount->szUser.empty())
+		{
+			bRenewed = client->login(pAccount->szUser, pAccount->szPassword);
+			if (bRenewed && !pAccount->szAuthFile.empty())
+				client->save_auth_to_file(pAccount->szAuthFile);
+		}
+		update_account_state(pAccount);
+
+		if (!bRenewed)
+		{
+			std::lock_guard<std::mutex> lock(m_mtxAccounts);
+			pAccount->tNextRenewal = std::chrono::steady_clock::now() + std::chrono::seconds(SESSION_TOKEN_RETRY_DELAY);
+		}
+	}
+	return static_cast<int>(vDue.size() - batchEnd);
+}
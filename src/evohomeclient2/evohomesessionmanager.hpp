@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Multi-account session manager for UK/EMEA Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#ifndef _EvohomeSessionManager
+#define _EvohomeSessionManager
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include "evohomeclient2.hpp"
+
+
+namespace evohome {
+  namespace session {
+
+    typedef struct _sAccount
+    {
+      std::string szAccountId;
+      std::string szUser;
+      std::string szPassword;
+      std::string szAuthFile;
+      std::unique_ptr<EvohomeClient2> client;
+      std::mutex mtxClient;
+
+      // guarded by the session manager's account lock
+      time_t tTokenExpiration;
+      std::chrono::steady_clock::time_point tNextRenewal;
+      bool bInstallationLoaded;
+    } account;
+
+  }; // namespace session
+
+}; // namespace evohome
+
+
+class EvohomeSessionManager
+{
+public:
+/************************************************************************
+ *									*
+ *	Class construct							*
+ *									*
+ *	The session manager holds one client for every registered	*
+ *	account. All clients share the process wide HTTP transport	*
+ *	and request rate limit. Sessions are opened on first use,	*
+ *	from the account's auth file if one is set.			*
+ *									*
+ *	When started, a worker thread renews the access token of every	*
+ *	open session before it expires. Renewals are made in batches	*
+ *	of limited size so that a large number of accounts does not	*
+ *	cause a burst of requests.					*
+ *									*
+ ************************************************************************/
+
+	EvohomeSessionManager();
+	~EvohomeSessionManager();
+
+	bool start();
+	void stop();
+	bool is_running();
+
+
+/************************************************************************
+ *									*
+ *	Accounts							*
+ *									*
+ *	The account ID is any unique name chosen by the application.	*
+ *	If an auth file is set the session is saved to and restored	*
+ *	from that file, so that it survives a restart.			*
+ *									*
+ ************************************************************************/
+
+	bool add_account(const std::string &szAccountId, const std::string &szUser, const std::string &szPassword, const std::string &szAuthFile = "");
+	bool remove_account(const std::string &szAccountId);
+	std::vector<std::string> get_account_ids();
+	size_t get_account_count();
+
+
+/************************************************************************
+ *									*
+ *	Client access							*
+ *									*
+ *	execute() runs fCommand with exclusive access to the client of	*
+ *	the account. The session is opened and the installation is	*
+ *	loaded before fCommand is called.				*
+ *									*
+ *	To bound memory use only the installations of the most recently	*
+ *	used accounts are kept loaded. Older installations are released	*
+ *	and loaded again on the next call to execute().		*
+ *									*
+ ************************************************************************/
+
+	bool execute(const std::string &szAccountId, std::function<bool(EvohomeClient2*)> fCommand);
+
+
+/************************************************************************
+ *									*
+ *	Config options							*
+ *									*
+ ************************************************************************/
+
+	void set_token_refresh_margin(const int seconds);
+	void set_refresh_batch_size(const int batchSize);
+	void set_max_loaded_installations(const int maxLoaded);
+	void set_rate_limit(const double dRequestsPerSecond, const int iBurst);
+
+
+private:
+	void run();
+	std::shared_ptr<evohome::session::account> find_account(const std::string &szAccountId);
+	bool open_session(evohome::session::account *pAccount);
+	void update_account_state(evohome::session::account *pAccount);
+	void trim_installations(const std::string &szKeepId);
+	int refresh_due_tokens(std::chrono::steady_clock::time_point &tNextWake);
+
+private:
+	std::map<std::string, std::shared_ptr<evohome::session::account> > m_mAccounts;
+	std::list<std::string> m_lLoadedInstallations;
+	std::mutex m_mtxAccounts;
+
+	std::thread m_thread;
+	std::mutex m_mtxState;
+	std::condition_variable m_cvState;
+	bool m_bRunning;
+	bool m_bStopRequested;
+
+	int m_iTokenRefreshMargin;
+	int m_iRefreshBatchSize;
+	int m_iMaxLoadedInstallations;
+};
+
+#endif
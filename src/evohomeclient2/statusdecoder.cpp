@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Typed status decoder for UK/EMEA Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#include <cstring>
+#include <cstdlib>
+#include "statusdecoder.hpp"
+#include "API2.hpp"
+#include "../time/IsoTimeString.hpp"
+
+
+bool StatusDecoder::decode(const std::string &szInput, evohome::device::status::location &statusLocation)
+{
+	statusLocation.vGatewayIds.clear();
+	statusLocation.vSystems.clear();
+	statusLocation.vZones.clear();
+
+	StatusDecoder decoder(statusLocation);
+	return JsonSaxReader::parse(szInput.c_str(), szInput.c_str() + szInput.size(), decoder);
+}
+
+
+/* private */ StatusDecoder::StatusDecoder(evohome::device::status::location &statusLocation) :
+	m_statusLocation(statusLocation), m_eNextContext(ignore), m_eField(none), m_bInZone(false)
+{
+	m_system = evohome::device::status::system();
+	m_zone = evohome::device::status::zone();
+	m_fault = evohome::device::status::fault();
+}
+
+
+bool StatusDecoder::key(const char *szKey, const size_t len)
+{
+	m_eField = none;
+	m_eNextContext = ignore;
+	switch (m_vContext.back())
+	{
+		case root:
+			if (key_is(szKey, len, "gateways"))
+				m_eNextContext = gateways;
+			break;
+		case gateway:
+			if (key_is(szKey, len, "gatewayId"))
+				m_eField = gatewayId;
+			else if (key_is(szKey, len, "temperatureControlSystems"))
+				m_eNextContext = systems;
+			break;
+		case system:
+			if (key_is(szKey, len, "systemId"))
+				m_eField = systemId;
+			else if (key_is(szKey, len, "zones"))
+				m_eNextContext = zones;
+			else if (key_is(szKey, len, "dhw"))
+				m_eNextContext = dhw;
+			else if (key_is(szKey, len, "systemModeStatus"))
+				m_eNextContext = systemModeStatus;
+			else if (key_is(szKey, len, "activeFaults"))
+				m_eNextContext = faults;
+			break;
+		case zone:
+			if (key_is(szKey, len, "zoneId"))
+				m_eField = zoneId;
+			else if (key_is(szKey, len, "temperatureStatus"))
+				m_eNextContext = temperatureStatus;
+			else if (key_is(szKey, len, "setpointStatus"))
+				m_eNextContext = setpointStatus;
+			else if (key_is(szKey, len, "activeFaults"))
+				m_eNextContext = faults;
+			break;
+		case dhw:
+			if (key_is(szKey, len, "dhwId"))
+				m_eField = dhwId;
+			else if (key_is(szKey, len, "temperatureStatus"))
+				m_eNextContext = temperatureStatus;
+			else if (key_is(szKey, len, "stateStatus"))
+				m_eNextContext = stateStatus;
+			else if (key_is(szKey, len, "activeFaults"))
+				m_eNextContext = faults;
+			break;
+		case temperatureStatus:
+			if (key_is(szKey, len, "temperature"))
+				m_eField = temperature;
+			break;
+		case setpointStatus:
+			if (key_is(szKey, len, "targetHeatTemperature"))
+				m_eField = targetHeatTemperature;
+			else if (key_is(szKey, len, "setpointMode"))
+				m_eField = setpointMode;
+			else if (key_is(szKey, len, "until"))
+				m_eField = until;
+			break;
+		case stateStatus:
+			if (key_is(szKey, len, "state"))
+				m_eField = state;
+			else if (key_is(szKey, len, "mode"))
+				m_eField = mode;
+			else if (key_is(szKey, len, "until"))
+				m_eField = until;
+			break;
+		case systemModeStatus:
+			if (key_is(szKey, len, "mode"))
+				m_eField = mode;
+			else if (key_is(szKey, len, "isPermanent"))
+				m_eField = isPermanent;
+			else if (key_is(szKey, len, "timeUntil"))
+				m_eField = timeUntil;
+			break;
+		case fault:
+			if (key_is(szKey, len, "faultType"))
+				m_eField = faultType;
+			else if (key_is(szKey, len, "since"))
+				m_eField = since;
+			break;
+		default:
+			break;
+	}
+	return ((m_eField != none) || (m_eNextContext != ignore));
+}
+
+
+void StatusDecoder::start_object()
+{
+	context eContext = root;
+	if (!m_vContext.empty())
+	{
+		switch (m_vContext.back())
+		{
+			case gateways:
+				eContext = gateway;
+				break;
+			case systems:
+				eContext = system;
+				break;
+			case zones:
+				eContext = zone;
+				break;
+			case faults:
+				eContext = fault;
+				break;
+			case ignore:
+				eContext = ignore;
+				break;
+			default:
+				eContext = m_eNextContext;
+				break;
+		}
+	}
+
+	switch (eContext)
+	{
+		case system:
+			m_szSystemId.clear();
+			m_system = evohome::device::status::system();
+			m_system.bValid = true;
+			m_system.mode = -1;
+			break;
+		case zone:
+		case dhw:
+			m_szZoneId.clear();
+			m_zone = evohome::device::status::zone();
+			m_zone.bValid = true;
+			m_zone.mode = -1;
+			m_zone.state = -1;
+			m_bInZone = true;
+			break;
+		case fault:
+			m_fault = evohome::device::status::fault();
+			break;
+		case gateways:
+		case systems:
+		case zones:
+		case faults:
+			// expected an array
+			eContext = ignore;
+			break;
+		default:
+			break;
+	}
+	m_vContext.push_back(eContext);
+	m_eNextContext = ignore;
+	m_eField = none;
+}
+
+
+void StatusDecoder::end_object()
+{
+	switch (m_vContext.back())
+	{
+		case system:
+			if (!m_szSystemId.empty())
+				m_statusLocation.vSystems.push_back(std::make_pair(m_szSystemId, m_system));
+			break;
+		case zone:
+		case dhw:
+			if (!m_szZoneId.empty())
+				m_statusLocation.vZones.push_back(std::make_pair(m_szZoneId, m_zone));
+			m_bInZone = false;
+			break;
+		case fault:
+			if (m_bInZone)
+				m_zone.vFaults.push_back(m_fault);
+			else
+				m_system.vFaults.push_back(m_fault);
+			break;
+		default:
+			break;
+	}
+	m_vContext.pop_back();
+}
+
+
+void StatusDecoder::start_array()
+{
+	context eContext = ignore;
+	if (!m_vContext.empty())
+	{
+		switch (m_vContext.back())
+		{
+			case gateways:
+			case systems:
+			case zones:
+			case faults:
+			case ignore:
+				break;
+			default:
+				if ((m_eNextContext == gateways) || (m_eNextContext == systems) || (m_eNextContext == zones) || (m_eNextContext == faults))
+					eContext = m_eNextContext;
+				break;
+		}
+	}
+	m_vContext.push_back(eContext);
+	m_eNextContext = ignore;
+	m_eField = none;
+}
+
+
+void StatusDecoder::end_array()
+{
+	m_vContext.pop_back();
+}
+
+
+void StatusDecoder::string_value(const char *str, const size_t len)
+{
+	switch (m_eField)
+	{
+		case gatewayId:
+			m_statusLocation.vGatewayIds.push_back(std::string(str, len));
+			break;
+		case systemId:
+			m_szSystemId.assign(str, len);
+			break;
+		case zoneId:
+		case dhwId:
+			m_szZoneId.assign(str, len);
+			break;
+		case setpointMode:
+			m_zone.mode = find_mode(evohome::API2::zone::mode, 7, str, len);
+			break;
+		case state:
+			m_zone.state = find_mode(evohome::API2::dhw::state, 2, str, len);
+			break;
+		case mode:
+			if (m_vContext.back() == stateStatus)
+				m_zone.mode = find_mode(evohome::API2::zone::mode, 7, str, len);
+			else
+				m_system.mode = find_mode(evohome::API2::system::mode, 7, str, len);
+			break;
+		case until:
+			m_zone.tUntil = IsoTimeString::utc_to_time_t(str, len);
+			if (m_zone.tUntil < 0)
+				m_zone.tUntil = 0;
+			break;
+		case timeUntil:
+			m_system.tUntil = IsoTimeString::utc_to_time_t(str, len);
+			if (m_system.tUntil < 0)
+				m_system.tUntil = 0;
+			break;
+		case faultType:
+			m_fault.szFaultType.assign(str, len);
+			break;
+		case since:
+			m_fault.tSince = IsoTimeString::utc_to_time_t(str, len);
+			break;
+		default:
+			break;
+	}
+	m_eField = none;
+}
+
+
+void StatusDecoder::number_value(const char *str, const size_t len)
+{
+	if ((m_eField == temperature) || (m_eField == targetHeatTemperature))
+	{
+		// the number is not terminated in the input
+		char cNumber[32];
+		double dValue;
+		if (len < sizeof(cNumber))
+		{
+			memcpy(cNumber, str, len);
+			cNumber[len] = '\0';
+			dValue = strtod(cNumber, NULL);
+		}
+		else
+			dValue = strtod(std::string(str, len).c_str(), NULL);
+
+		if (m_eField == temperature)
+		{
+			m_zone.dTemperature = dValue;
+			m_zone.bTemperatureAvailable = true;
+		}
+		else
+			m_zone.dSetpoint = dValue;
+	}
+	m_eField = none;
+}
+
+
+void StatusDecoder::bool_value(const bool bValue)
+{
+	if (m_eField == isPermanent)
+		m_system.bPermanent = bValue;
+	m_eField = none;
+}
+
+
+void StatusDecoder::null_value()
+{
+	m_eField = none;
+}
+
+
+/* private */ int8_t StatusDecoder::find_mode(const std::string *szModes, const int numModes, const char *str, const size_t len)
+{
+	if (len == 0)
+		return -1;
+	for (int i = 0; i < numModes; i++)
+	{
+		if ((szModes[i].size() == len) && (memcmp(szModes[i].c_str(), str, len) == 0))
+			return static_cast<int8_t>(i);
+	}
+	return -1;
+}
+
+
+/* private */ bool StatusDecoder::key_is(const char *szKey, const size_t len, const char *szName)
+{
+	return ((strlen(szName) == len) && (memcmp(szKey, szName, len) == 0));
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020 Gordon Bos <gordon@bosvangennip.nl> All rights reserved.
+ *
+ * Typed status decoder for UK/EMEA Evohome API
+ *
+ *
+ * Source code subject to GNU GENERAL PUBLIC LICENSE version 3
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include "../common/devices.hpp"
+#include "../common/JsonSaxReader.hpp"
+
+
+class StatusDecoder : public JsonSaxReader::Handler
+{
+public:
+
+/*
+ * Decode a location status response in a single pass
+ *
+ * Temperatures, setpoints, modes, end times and active faults of every system,
+ * zone and hot water device are written into statusLocation. No json tree is
+ * built and members that are not part of the typed status are skipped.
+ */
+	static bool decode(const std::string &szInput, evohome::device::status::location &statusLocation);
+
+
+	bool key(const char *szKey, const size_t len);
+	void start_object();
+	void end_object();
+	void start_array();
+	void end_array();
+	void string_value(const char *str, const size_t len);
+	void number_value(const char *str, const size_t len);
+	void bool_value(const bool bValue);
+	void null_value();
+
+
+private:
+	explicit StatusDecoder(evohome::device::status::location &statusLocation);
+
+	enum context
+	{
+		ignore,
+		root,
+		gateways,
+		gateway,
+		systems,
+		system,
+		zones,
+		zone,
+		dhw,
+		temperatureStatus,
+		setpointStatus,
+		stateStatus,
+		systemModeStatus,
+		faults,
+		fault
+	};
+
+	enum field
+	{
+		none,
+		gatewayId,
+		systemId,
+		zoneId,
+		dhwId,
+		temperature,
+		targetHeatTemperature,
+		setpointMode,
+		until,
+		state,
+		mode,
+		isPermanent,
+		timeUntil,
+		faultType,
+		since
+	};
+
+	static int8_t find_mode(const std::string *szModes, const int numModes, const char *str, const size_t len);
+	static bool key_is(const char *szKey, const size_t len, const char *szName);
+
+private:
+	evohome::device::status::location &m_statusLocation;
+	std::vector<context> m_vContext;
+	context m_eNextContext;
+	field m_eField;
+	bool m_bInZone;
+
+	std::string m_szSystemId;
+	evohome::device::status::system m_system;
+	std::string m_szZoneId;
+	evohome::device::status::zone m_zone;
+	evohome::device::status::fault m_fault;
+};
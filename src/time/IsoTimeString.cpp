@@ -151,3 +151,73 @@ std::string IsoTimeString::utc_to_local(const std::string szUTCTime)
 }
 
 
+/*
+ * Convert a localtime ISO datetime string to epoch time
+ */
+time_t IsoTimeString::local_to_time_t(const std::string szLocalTime)
+{
+	if (szLocalTime.size() <  19)
+		return -1;
+	struct tm ltime;
+	ltime.tm_isdst = -1;
+	ltime.tm_year = atoi(szLocalTime.substr(0, 4).c_str()) - 1900;
+	ltime.tm_mon = atoi(szLocalTime.substr(5, 2).c_str()) - 1;
+	ltime.tm_mday = atoi(szLocalTime.substr(8, 2).c_str());
+	ltime.tm_hour = atoi(szLocalTime.substr(11, 2).c_str());
+	ltime.tm_min = atoi(szLocalTime.substr(14, 2).c_str());
+	ltime.tm_sec = atoi(szLocalTime.substr(17, 2).c_str());
+	return mktime(&ltime);
+}
+
+
+/*
+ * Convert a UTC ISO datetime string to epoch time
+ *
+ * Calculated directly from the calendar date, so the result does not depend on
+ * the local timezone. Fractional seconds and a trailing 'Z' are ignored.
+ */
+time_t IsoTimeString::utc_to_time_t(const char *szUTCTime, const size_t len)
+{
+	if (len < 19)
+		return -1;
+	int field[6];
+	static const int offset[6] = {0, 5, 8, 11, 14, 17};
+	static const int width[6] = {4, 2, 2, 2, 2, 2};
+	for (int i = 0; i < 6; i++)
+	{
+		field[i] = 0;
+		for (int j = 0; j < width[i]; j++)
+		{
+			char c = szUTCTime[offset[i] + j];
+			if ((c < '0') || (c > '9'))
+				return -1;
+			field[i] = field[i] * 10 + (c - '0');
+		}
+	}
+
+	// days since 1970-01-01 in the proleptic Gregorian calendar
+	int year = field[0];
+	int month = field[1];
+	if (month <= 2)
+		year--;
+	int era = ((year >= 0) ? year : year - 399) / 400;
+	int yoe = year - era * 400;
+	int doy = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + field[2] - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	long long days = static_cast<long long>(era) * 146097 + doe - 719468;
+
+	return static_cast<time_t>(days * 86400 + field[3] * 3600 + field[4] * 60 + field[5]);
+}
+
+
+/*
+ * Convert epoch time to a UTC ISO datetime string
+ */
+std::string IsoTimeString::time_t_to_utc(const time_t tUTCTime)
+{
+	struct tm utime;
+	gmtime_r(&tUTCTime, &utime);
+	char cUntil[22];
+	sprintf_s(cUntil, 22, "%04d-%02d-%02dT%02d:%02d:%02dZ", (utime.tm_year&0xFFF) + 1900, (utime.tm_mon&0xF) + 1, utime.tm_mday&0x3F, utime.tm_hour&0x3F, utime.tm_min&0x3F, utime.tm_sec&0x3F);
+	return std::string(cUntil);
+}
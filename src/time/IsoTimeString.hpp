@@ -5,6 +5,7 @@
  ************************************************************************/
 #pragma once
 #include <string>
+#include <ctime>
 
 
 class IsoTimeString
@@ -30,6 +31,19 @@ public:
 	static std::string utc_to_local(const std::string szUTCTime);
 
 
+/*
+ * Convert a localtime ISO datetime string to epoch time
+ */
+	static time_t local_to_time_t(const std::string szLocalTime);
+
+
+/*
+ * Convert a UTC ISO datetime string to epoch time and back
+ */
+	static time_t utc_to_time_t(const char *szUTCTime, const size_t len);
+	static std::string time_t_to_utc(const time_t tUTCTime);
+
+
 
 private:
 	static int m_tzoffset;